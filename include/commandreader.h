@@ -0,0 +1,32 @@
+#ifndef __COMMANDREADER_H_
+#define __COMMANDREADER_H_
+
+#include <cstddef>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Reads commands one line at a time, either interactively from std::cin or,
+// in batch mode, from a file (or stdin) in large blocks. Returned lines are
+// null-terminated in place and stay valid until the next call to nextLine().
+class CommandReader {
+private:
+    FILE *_file;       // NULL when reading interactively
+    std::string _line; // interactive mode line buffer
+    std::vector<char> _buffer;
+    size_t _start;     // first unread byte in _buffer
+    size_t _end;       // one past the last byte read into _buffer
+    bool _eof;
+
+public:
+    CommandReader(FILE *file);
+    ~CommandReader();
+
+    // Returns the next line without its line terminator, or NULL at end of input
+    char* nextLine();
+};
+
+// Splits a command line into tokens in place (separators are replaced with '\0')
+void splitCommand(char *command, std::vector<const char *> &tokens);
+
+#endif // __COMMANDREADER_H_
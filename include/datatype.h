@@ -0,0 +1,135 @@
+#ifndef __DATATYPE_H_
+#define __DATATYPE_H_
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+// Element types of variables, X(DataType, C++ type, name in commands).
+// Adding a line here adds the type to allocate, set and print; new types go
+// last so that the DataType values stored in traces and images don't change
+#define ELEMENT_TYPES(X)           \
+    X(Char,   char,   "char")      \
+    X(Short,  short,  "short")     \
+    X(Int,    int,    "int")       \
+    X(Float,  float,  "float")     \
+    X(Long,   long,   "long")      \
+    X(Double, double, "double")
+
+#define DATA_TYPE_ENUM(type, ctype, name) type,
+enum DataType : uint8_t {FreeSpace, ELEMENT_TYPES(DATA_TYPE_ENUM) Err};
+#undef DATA_TYPE_ENUM
+
+// C++ type and command name of each element DataType, and the DataType of
+// each C++ element type
+template <DataType type> struct ElementType;
+template <typename T> struct TypeOf;
+
+#define ELEMENT_TYPE_TRAITS(type, ctype, name)                                          \
+    template <> struct ElementType<DataType::type> { typedef ctype Type; };             \
+    template <> struct TypeOf<ctype> { static const DataType value = DataType::type; };
+ELEMENT_TYPES(ELEMENT_TYPE_TRAITS)
+#undef ELEMENT_TYPE_TRAITS
+
+// Bytes per element, indexed by DataType. Free space counts bytes
+#define ELEMENT_TYPE_SIZE(type, ctype, name) sizeof(ctype),
+static const uint32_t data_type_sizes[] = {1, ELEMENT_TYPES(ELEMENT_TYPE_SIZE) (uint32_t)-1};
+#undef ELEMENT_TYPE_SIZE
+
+#define ELEMENT_TYPE_NAME(type, ctype, name) name,
+static const char *const data_type_names[] = {"free space", ELEMENT_TYPES(ELEMENT_TYPE_NAME) "error"};
+#undef ELEMENT_TYPE_NAME
+
+inline uint32_t dataTypeSize(DataType type)
+{
+    return type <= DataType::Err ? data_type_sizes[type] : (uint32_t)-1;
+}
+
+// DataType named `name` in a command, Err if there is none
+inline DataType dataTypeFromName(const char *name)
+{
+    int type;
+    for (type = DataType::Char; type < DataType::Err; type++)
+    {
+        if (strcmp(name, data_type_names[type]) == 0)
+        {
+            return (DataType)type;
+        }
+    }
+    return DataType::Err;
+}
+
+// Whole number of an integer element type, false if it doesn't fit
+template <typename T>
+bool parseNumber(const char *token, T *value, std::true_type)
+{
+    errno = 0;
+    long number = strtol(token, NULL, 10);
+    if (errno == ERANGE || number > (long)std::numeric_limits<T>::max())
+    {
+        return false;
+    }
+    *value = (T)number;
+    return true;
+}
+
+// Number of a floating point element type, false if it doesn't fit
+template <typename T>
+bool parseNumber(const char *token, T *value, std::false_type)
+{
+    errno = 0;
+    double number = strtod(token, NULL);
+    if (errno == ERANGE || number > std::numeric_limits<T>::max())
+    {
+        return false;
+    }
+    *value = (T)number;
+    return true;
+}
+
+// Parse one element from a command token: a char is its first character,
+// numbers are unsigned decimal integers converted to the element type.
+// Returns false if the token isn't such a number or doesn't fit the type
+inline bool parseElement(const char *token, char *value)
+{
+    *value = *token;
+    return true;
+}
+
+template <typename T>
+bool parseElement(const char *token, T *value)
+{
+    int i;
+    for (i = 0; token[i] != '\0'; i++)
+    {
+        if (token[i] < '0' || token[i] > '9')
+        {
+            return false;
+        }
+    }
+    return i > 0 && parseNumber(token, value, std::is_integral<T>());
+}
+
+// Call Kernel::run<T>(args...) with the C++ type T of an element DataType,
+// so that the kernel handles a whole run of elements without branching on
+// the type again. Returns false if `type` isn't an element type
+template <typename Kernel, typename... Args>
+bool dispatchElementType(DataType type, Args &&... args)
+{
+    switch (type)
+    {
+#define ELEMENT_TYPE_CASE(type, ctype, name) \
+        case DataType::type: Kernel::template run<ctype>(std::forward<Args>(args)...); return true;
+        ELEMENT_TYPES(ELEMENT_TYPE_CASE)
+#undef ELEMENT_TYPE_CASE
+        default:
+            return false;
+    }
+}
+
+#endif // __DATATYPE_H_
@@ -0,0 +1,66 @@
+#ifndef __EPOCH_H_
+#define __EPOCH_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Threads that can be inside an epoch at once, more wait for a free slot
+#define EPOCH_SLOTS 64
+// Retired objects to collect before trying to free them
+#define EPOCH_RECLAIM_BATCH 64
+
+typedef struct EpochSlot {
+    std::atomic<uint64_t> epoch; // epoch the reader entered, 0 if the slot is free
+    char padding[56];            // one slot per cache line
+} EpochSlot;
+
+typedef struct EpochRetired {
+    void *object;
+    void (*destroy)(void *object, void *context);
+    void *context;
+    uint64_t epoch; // global epoch when the object was unlinked
+} EpochRetired;
+
+// Epoch based reclamation for structures that are read without locks.
+// Readers enter the domain (through an EpochGuard) for as long as they hold
+// pointers into the structure. A writer that unlinks an object retires it
+// instead of freeing it, and it is only destroyed once every reader that
+// entered before it was unlinked has left. Writers must be serialised by
+// the caller, readers never block each other or the writers.
+class EpochDomain {
+private:
+    std::atomic<uint64_t> _epoch;
+    EpochSlot _slots[EPOCH_SLOTS];
+    std::vector<EpochRetired> _retired;
+
+    void reclaim();
+
+public:
+    EpochDomain();
+    // Destroys everything still retired, no reader may be inside
+    ~EpochDomain();
+
+    // Returns the slot the reader holds until exit()
+    int enter();
+    void exit(int slot);
+    // Destroy `object` with destroy(object, context) once no reader can see it
+    void retire(void *object, void (*destroy)(void *object, void *context), void *context);
+};
+
+// Keeps the calling thread inside an epoch domain for its lifetime
+class EpochGuard {
+private:
+    EpochDomain *_domain;
+    int _slot;
+
+public:
+    EpochGuard(EpochDomain *domain);
+    ~EpochGuard();
+
+    // Slot held by this reader, no other reader holds it meanwhile
+    int slot();
+};
+
+#endif // __EPOCH_H_
@@ -0,0 +1,41 @@
+#ifndef __FRAMEALLOCATOR_H_
+#define __FRAMEALLOCATOR_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// Physical frame allocator that always hands out the lowest free frame.
+// Frames are tracked in a bitmap (bit set = frame in use) with a summary
+// bitmap on top (bit set = bitmap word is full), so finding the lowest free
+// frame is a couple of find-first-zero word scans. Every call takes a lock,
+// so page tables of different shards can share one allocator.
+class FrameAllocator {
+private:
+    std::vector<uint64_t> _bitmap;
+    std::vector<uint64_t> _summary;
+    size_t _first_summary; // no free frames below this summary word
+    uint32_t _used;
+    std::mutex _lock;
+
+    void release(int frame);
+
+public:
+    FrameAllocator();
+    ~FrameAllocator();
+
+    int allocate();
+    // Lowest run of `count` (a multiple of 64) free frames aligned to
+    // `count`, all below `limit`. Returns the first frame or -1
+    int allocateRun(int count, int limit);
+    // Marks a specific frame as used so allocate() never hands it out
+    void reserve(int frame);
+    void free(int frame);
+    // Returns many frames under a single lock, e.g. all frames of a process
+    void freeFrames(const std::vector<int> &frames);
+    bool isUsed(int frame);
+    uint32_t framesInUse();
+};
+
+#endif // __FRAMEALLOCATOR_H_
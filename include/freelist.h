@@ -0,0 +1,125 @@
+#ifndef __FREELIST_H_
+#define __FREELIST_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <utility>
+
+class ImageWriter;
+class ImageReader;
+
+enum AllocPolicy : uint8_t {FirstFit, NextFit, BestFit, WorstFit, Segregated, Buddy};
+
+// Free blocks are counted by size class, floor(log2(size))
+#define FREE_SIZE_CLASSES 32
+
+typedef struct FragmentationMetrics {
+    uint32_t free_bytes;
+    uint32_t free_blocks;
+    uint32_t largest_free_block;
+    uint32_t internal_bytes;       // bytes reserved beyond what was requested (rounding)
+    double external_fragmentation; // 1 - largest_free_block / free_bytes
+    uint32_t size_classes[FREE_SIZE_CLASSES]; // free blocks in [2^i, 2^(i+1)) bytes
+} FragmentationMetrics;
+
+// Free blocks by address, every subtree knowing its largest block, so the
+// lowest block of at least some size at or above some address is found in
+// O(log n). A treap whose nodes are indices into one vector, so copying the
+// tree copies every node along.
+typedef struct FitNode {
+    uint32_t address;
+    uint32_t size;
+    uint32_t max_size; // largest block in the subtree
+    uint32_t priority;
+    int left;
+    int right;
+} FitNode;
+
+class FitTree {
+private:
+    std::vector<FitNode> _nodes;
+    std::vector<int> _free_nodes;
+    int _root;
+    uint32_t _seed;
+    std::vector<int> _path; // scratch for resize()
+
+    void update(int node);
+    void split(int node, uint32_t address, int *left, int *right);
+    int merge(int left, int right);
+    int find(int node, uint32_t size, uint32_t from);
+
+public:
+    FitTree();
+
+    void insert(uint32_t address, uint32_t size);
+    void erase(uint32_t address);
+    void resize(uint32_t address, uint32_t new_address, uint32_t new_size);
+    // Address of the lowest block of at least `size` bytes that starts at or
+    // above `from`, or -1 if there is none
+    int lowestFit(uint32_t size, uint32_t from);
+};
+
+// Free blocks of one process's virtual address space. Blocks are indexed by
+// address (for coalescing), by address with subtree maxima (for first-fit
+// and next-fit) and by size (for best-fit, worst-fit and the largest block),
+// so allocate and release are O(log n) in the number of free blocks for
+// every policy.
+class FreeList {
+private:
+    AllocPolicy _policy;
+    uint32_t _size;
+    std::map<uint32_t, uint32_t> _by_address;           // address -> size
+    std::set<std::pair<uint32_t, uint32_t> > _by_size;  // (size, address)
+    uint32_t _free_bytes;
+    uint32_t _requested_bytes; // bytes asked for by live allocations
+    uint32_t _reserved_bytes;  // bytes handed out to live allocations
+    uint32_t _rover;           // next-fit: address to resume searching from
+    uint32_t _size_classes[FREE_SIZE_CLASSES]; // free blocks per size class, for metrics()
+
+    // First-fit and next-fit: the free blocks again, searchable by size in address order
+    FitTree _fits;
+
+    // Segregated fit: free block addresses grouped by floor(log2(size)),
+    // with a bit set in _class_mask for every non-empty class
+    std::vector<std::set<uint32_t> > _classes;
+    uint64_t _class_mask;
+
+    // Buddy system: free blocks grouped by order, and the order of every live block
+    int _max_order;
+    std::vector<std::set<uint32_t> > _buddy_free;
+    std::unordered_map<uint32_t, int> _buddy_allocated;
+
+    void indexBlock(uint32_t address, uint32_t size, bool add);
+    void insertBlock(uint32_t address, uint32_t size);
+    void removeBlock(uint32_t address, uint32_t size);
+    void resizeBlock(uint32_t address, uint32_t size, uint32_t new_address, uint32_t new_size);
+    void takeFromBlock(uint32_t block_address, uint32_t block_size, uint32_t size);
+    int allocateBuddy(uint32_t size);
+    int releaseBuddy(uint32_t address);
+
+public:
+    FreeList(uint32_t size, AllocPolicy policy);
+    ~FreeList();
+
+    // Reserves `size` bytes and returns their address, or -1 if no block fits
+    int allocate(uint32_t size);
+    // Returns a block handed out by allocate, coalescing it with free
+    // neighbours. Returns the number of free blocks it was merged with
+    int release(uint32_t address, uint32_t size);
+
+    AllocPolicy policy();
+    FragmentationMetrics metrics();
+
+    // Simulator images (see image.h). loadImage() replaces the contents of this
+    // free list, which must have the size and policy that were saved
+    void saveImage(ImageWriter &out);
+    bool loadImage(ImageReader &in);
+};
+
+const char* allocPolicyName(AllocPolicy policy);
+
+#endif // __FREELIST_H_
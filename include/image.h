@@ -0,0 +1,102 @@
+#ifndef __IMAGE_H_
+#define __IMAGE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+class Mmu;
+class PageTable;
+
+// Simulator image format
+//
+// An image file is an ImageHeader followed by the Mmu state (next pid,
+// counters, and every process with its variables and free list), the
+// PageTable state (translations, large and huge pages, swapped out pages
+// and paging counters) and then the frame section. The frame section holds
+// the frames in use and then the swap slots in use (the swap file doesn't
+// outlive the simulator), each as its number and contents. Values are
+// stored in host byte order, images are not portable.
+//
+// A checkpoint is an image whose frame section only holds the frames and
+// slots written or mapped since its parent image was saved, the rest of it
+// is complete. Loading a full image followed by a chain of checkpoints takes
+// the state from the last one and each frame and slot from the newest
+// image that holds it.
+
+#define IMAGE_MAGIC "MEMIMAGE"
+#define IMAGE_VERSION 2
+
+typedef struct ImageHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t page_size;
+    uint64_t memory_size;
+    uint64_t id;
+    uint64_t parent; // image a checkpoint builds on, 0 for a full image
+    uint64_t frames_offset; // file offset of the frame section
+} ImageHeader;
+
+// Sequential writer of the sections of an image
+class ImageWriter {
+private:
+    FILE *_file;
+    bool _ok;
+
+public:
+    ImageWriter(FILE *file);
+
+    void write(const void *data, size_t size);
+    void writeString(const std::string &string);
+    bool ok();
+
+    template <typename T>
+    void put(const T &value)
+    {
+        write(&value, sizeof(value));
+    }
+};
+
+// Sequential reader over a memory-mapped image. Reads past the end fail
+// (ok() turns false) and return zeros
+class ImageReader {
+private:
+    const uint8_t *_data;
+    size_t _size;
+    size_t _offset;
+    bool _ok;
+
+public:
+    ImageReader(const uint8_t *data, size_t size);
+
+    bool read(void *data, size_t size);
+    void seek(size_t offset);
+    // Pointer to the next `size` bytes of the mapping, or NULL
+    const uint8_t* take(size_t size);
+    std::string readString();
+    bool ok();
+
+    template <typename T>
+    T get()
+    {
+        T value = T();
+        read(&value, sizeof(value));
+        return value;
+    }
+};
+
+// "save <file>": returns false (after printing the error) if the image
+// can't be written
+bool saveImage(const char *path, Mmu *mmu, PageTable *page_table, uint32_t memory_size);
+// "checkpoint <file>": saves a checkpoint of the image last saved, loaded
+// or checkpointed, or a full image if there is none
+bool saveCheckpoint(const char *path, Mmu *mmu, PageTable *page_table, uint32_t memory_size);
+// "load <file> [<checkpoint> ...]": terminates every process, then
+// restores the ones of a full image and the checkpoints that follow it.
+// Returns false (after printing the error) if the images can't be loaded
+// into this simulator
+bool loadImage(const std::vector<const char *> &paths, Mmu *mmu, PageTable *page_table, uint32_t memory_size);
+
+#endif // __IMAGE_H_
@@ -0,0 +1,19 @@
+#ifndef __MEMOPS_H_
+#define __MEMOPS_H_
+
+#include <cstddef>
+#include <cstdint>
+
+// Byte kernels for the fill and cmp commands, working 16 bytes at a time
+// with SSE2 where the compiler targets it (every x86-64), a byte at a time
+// otherwise. Copies go through memcpy, which the C library already
+// vectorises.
+
+#define MEMOPS_WIDTH 16
+
+// Fill `size` bytes, byte i with pattern[i % MEMOPS_WIDTH]
+void fillPattern(uint8_t *destination, size_t size, const uint8_t *pattern);
+// Index of the first byte in which `a` and `b` differ, `size` if none does
+size_t firstDifference(const uint8_t *a, const uint8_t *b, size_t size);
+
+#endif // __MEMOPS_H_
@@ -0,0 +1,69 @@
+#ifndef __MEMSIM_H_
+#define __MEMSIM_H_
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include "mmu.h"
+#include "pagetable.h"
+
+// Simulator operations shared by the command loop and the trace replay engine
+
+void createProcess(int text_size, int data_size, Mmu *mmu, PageTable *page_table);
+void allocateVariable(uint32_t pid, std::string var_name, DataType type, uint32_t num_elements, Mmu *mmu, PageTable *page_table);
+void freeVariable(uint32_t pid, std::string var_name, Mmu *mmu, PageTable *page_table);
+void forkProcess(uint32_t pid, Mmu *mmu, PageTable *page_table);
+void terminateProcess(uint32_t pid, Mmu *mmu, PageTable *page_table);
+void compactProcess(uint32_t pid, Mmu *mmu, PageTable *page_table, void *memory);
+void compactIfFragmented(uint32_t pid, Mmu *mmu, PageTable *page_table, void *memory);
+Variable* findSetTarget(uint32_t pid, std::string var_name, uint32_t offset, Mmu *mmu);
+void printVariable(uint32_t pid, std::string var_name, Mmu *mmu, PageTable *page_table, void *memory);
+bool stringToIntTest(const std::string &input);
+bool pidExists(int pid, Mmu *mmu);
+bool parseValues(DataType type, std::vector<const char *> &tokens, int first, std::vector<uint8_t> &values);
+// "set <PID> <var_name> <offset> <value_0> ...": parse tokens[first..] as
+// elements of the variable's type and write them from element `offset`.
+// Returns the number of elements written, or -1 after printing the error
+int setVariable(uint32_t pid, std::string var_name, uint32_t offset, std::vector<const char *> &tokens, int first,
+                Mmu *mmu, PageTable *page_table, void *memory);
+
+// Bulk element access: copies `count` elements of `type` starting at element
+// `offset` of a variable, translating once per page and copying each
+// page-contiguous run with a single memcpy. Returns the number of elements
+// copied, or -1 (after printing the error) if the process or variable don't
+// exist, the type doesn't match or the range is out of bounds
+int writeElements(uint32_t pid, std::string var_name, DataType type, uint32_t offset, const void *values, uint32_t count,
+                  Mmu *mmu, PageTable *page_table, void *memory);
+int readElements(uint32_t pid, std::string var_name, DataType type, uint32_t offset, void *values, uint32_t count,
+                 Mmu *mmu, PageTable *page_table, void *memory);
+
+// Whole-variable operations: "fill <PID> <var> <value>" sets every element
+// to `value`, "copy <PID> <source> <destination>" copies the elements the
+// two variables have room for, and "cmp <PID> <var> <var>" compares them.
+// Each page-contiguous run is translated once and handled by a kernel of
+// memops.h. fill and copy return the number of elements written. cmp
+// returns 0 if the variables are equal and 1 otherwise, with the first
+// element that differs in `element` (the end of the shorter one if only
+// the sizes differ). All return -1 after printing the error if a variable
+// doesn't exist or the types don't match
+int fillVariable(uint32_t pid, std::string var_name, const char *value, Mmu *mmu, PageTable *page_table, void *memory);
+int copyVariable(uint32_t pid, std::string source_name, std::string destination_name, Mmu *mmu, PageTable *page_table,
+                 void *memory);
+int compareVariables(uint32_t pid, std::string first_name, std::string second_name, uint32_t *element, Mmu *mmu,
+                     PageTable *page_table, void *memory);
+
+template <typename T>
+int writeVariable(uint32_t pid, std::string var_name, uint32_t offset, const T *values, uint32_t count,
+                  Mmu *mmu, PageTable *page_table, void *memory)
+{
+    return writeElements(pid, var_name, TypeOf<T>::value, offset, values, count, mmu, page_table, memory);
+}
+
+template <typename T>
+int readVariable(uint32_t pid, std::string var_name, uint32_t offset, T *values, uint32_t count,
+                 Mmu *mmu, PageTable *page_table, void *memory)
+{
+    return readElements(pid, var_name, TypeOf<T>::value, offset, values, count, mmu, page_table, memory);
+}
+
+#endif // __MEMSIM_H_
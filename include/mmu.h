@@ -4,40 +4,128 @@
 #include <iostream>
 #include <string>
 #include <vector>
+#include <unordered_map>
+#include <unordered_set>
 #include <pagetable.h>
-
-enum DataType : uint8_t {FreeSpace, Char, Short, Int, Float, Long, Double, Err};
+#include <freelist.h>
+#include <pool.h>
+#include <stats.h>
+#include <datatype.h>
 
 typedef struct Variable {
-    std::string name;
+    const std::string *name; // interned in the Mmu's name table
     DataType type;
     uint32_t virtual_address;
     uint32_t size;
+    Variable *prev; // neighbours in the process's list of variables, in allocation order
+    Variable *next;
 } Variable;
 
+// A variable moved by compaction
+typedef struct Relocation {
+    Variable *variable;
+    uint32_t old_address;
+    uint32_t new_address;
+} Relocation;
+
+// Counters of a process, or of all processes that ever ran
+typedef struct MmuStats {
+    uint64_t allocations;        // variables allocated
+    uint64_t frees;              // variables freed
+    uint64_t failed_allocations; // allocations without enough free space
+    uint64_t coalesces;          // free blocks merged when variables were freed
+    uint64_t bytes_live;         // bytes held by live variables
+    uint64_t translations;       // virtual to physical translations for set and print
+} MmuStats;
+
+// Pages are counted by how full their live variables make them: under 25%,
+// 50%, 75% and 100% of the page used, and full
+#define PAGE_FILL_BUCKETS 5
+
+// Page granular space of a process, or of all processes, kept up to date as
+// variables are allocated and freed
+typedef struct PageUsage {
+    uint32_t pages;                   // pages holding live variables
+    uint64_t unused_bytes;            // bytes of those pages that no variable uses
+    uint32_t fill[PAGE_FILL_BUCKETS]; // pages per fill bucket
+} PageUsage;
+
 typedef struct Process {
     uint32_t pid;
-    std::vector<Variable*> variables;
+    // Variables of the process in allocation order, unlinked in O(1) when freed
+    Variable *first_variable;
+    Variable *last_variable;
+    uint32_t variable_count;
+    std::unordered_map<const std::string*, Variable*> variable_index; // interned name -> variable
+    Pool<Variable> variable_pool; // owns the Variable records of the process
+    FreeList *free_space;
+    MmuStats stats;
+    // page number -> bytes of live variables on it, a page is no longer
+    // needed once no entry is left for it
+    std::unordered_map<uint32_t, uint32_t> page_bytes;
+    PageUsage page_usage;
+    Process *prev; // neighbours in the Mmu's list of live processes, in creation order
+    Process *next;
 } Process;
 
 class Mmu {
 private:
     uint32_t _next_pid;
     uint32_t _max_size;
-    std::vector<Process*> _processes;
+    uint32_t _page_size;
+    int _page_shift;
+    int _compact_threshold; // percent of mapped page space left unused that triggers compaction, -1 if off
+    AllocPolicy _policy;
+    // Registry of live processes: looked up by pid, and listed in creation
+    // order, both O(1) to update
+    std::unordered_map<uint32_t, Process*> _process_index; // pid -> process
+    Process *_first_process;
+    Process *_last_process;
+    Pool<Process> _process_pool;
+    std::unordered_set<std::string> _names; // interned variable names
+    MmuStats _stats; // totals over every process, bytes_live over the live ones
+    LatencyHistogram _latency[SimOp::OpCount];
+    PageUsage _page_usage; // totals over the live processes
+
+    Process* getProcess(uint32_t pid);
+    void registerProcess(Process *proc);
+    void unregisterProcess(Process *proc);
+    void addPageBytes(Process *proc, uint32_t address, uint32_t size, bool add);
+    void addPageUsage(const PageUsage &usage, bool add);
+    FreeList* packVariables(Process *proc, std::vector<Variable*> &order, std::vector<int> &addresses);
 
 public:
-    Mmu(int memory_size);
+    Mmu(int memory_size, uint32_t page_size, AllocPolicy policy = AllocPolicy::FirstFit);
     ~Mmu();
 
     void deleteProcess(uint32_t pid);
     uint32_t createProcess();
+    bool hasProcess(uint32_t pid);
+    void processIds(std::vector<uint32_t> &pids);
+    uint32_t nextPid();
+    void setNextPid(uint32_t pid);
+    int forkProcess(uint32_t pid);
     void mergeFreeSpace(uint32_t pid, Variable *var);
-    bool isVariableInOwnPage(uint32_t pid, Variable* var, int page_number, PageTable *page_table);
+    uint32_t pageBytes(uint32_t pid, uint32_t page_number);
     Variable* getVariable(uint32_t pid, std::string name);
-    Variable* findFreeSpace(uint32_t pid, uint32_t size);
+    int findFreeSpace(uint32_t pid, uint32_t size);
     void addVariableToProcess(uint32_t pid, std::string var_name, DataType type, uint32_t size, uint32_t address);
     void print();
+    void printFreeSpace();
+    void printFragmentation(int pid);
+    bool planCompaction(uint32_t pid, std::vector<Relocation> &moves, std::vector<uint32_t> &released_pages);
+    bool compactProcess(uint32_t pid, std::vector<Relocation> &moves, std::vector<uint32_t> &released_pages);
+    void setCompactThreshold(int percent);
+    bool needsCompaction(uint32_t pid);
+    MmuStats* processStats(uint32_t pid);
+    MmuStats* stats();
+    void recordFailedAllocation(uint32_t pid);
+    void recordTranslations(uint32_t pid, uint32_t count);
+    void recordLatency(SimOp op, uint64_t ns);
+    const LatencyHistogram* latency(SimOp op);
+    // Simulator images (see image.h), loading needs an Mmu without processes
+    void saveImage(ImageWriter &out);
+    bool loadImage(ImageReader &in);
     DataType stringToDataType(std::string string);
     uint32_t sizeOfType(DataType type);
 };
@@ -0,0 +1,161 @@
+#ifndef __PAGEMAP_H_
+#define __PAGEMAP_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <unordered_map>
+#include "epoch.h"
+
+typedef struct PageMapEntry {
+    uint32_t pid;
+    int page_number;
+    int frame;
+} PageMapEntry;
+
+// Storage backend for the translations held by a PageTable
+class PageMap {
+protected:
+    uint64_t _walks;         // number of translations looked up
+    uint64_t _levels_walked; // table levels visited by those lookups
+
+public:
+    PageMap();
+    virtual ~PageMap();
+
+    // Returns the frame mapped to (pid, page_number), or -1 if unmapped
+    virtual int get(uint32_t pid, int page_number) = 0;
+    virtual void set(uint32_t pid, int page_number, int frame) = 0;
+    // Unmaps (pid, page_number), returns the frame it was mapped to or -1
+    virtual int erase(uint32_t pid, int page_number) = 0;
+    // Unmaps every page of a process, appending their frames to `frames`
+    virtual void eraseProcess(uint32_t pid, std::vector<int> &frames) = 0;
+    virtual void entries(std::vector<PageMapEntry> &out) = 0;
+    // Bytes of memory used to hold the translations
+    virtual size_t footprint() = 0;
+    virtual int levels() = 0;
+
+    virtual uint64_t walks();
+    virtual uint64_t levelsWalked();
+};
+
+// One flat array per process, indexed by page number
+class FlatPageMap : public PageMap {
+private:
+    std::unordered_map<uint32_t, std::vector<int> > _table;
+
+    // Most recently used process, saves the hash lookup for back-to-back translations
+    uint32_t _last_pid;
+    std::vector<int> *_last_pages;
+
+    std::vector<int>* processPages(uint32_t pid);
+
+public:
+    FlatPageMap();
+    ~FlatPageMap();
+
+    int get(uint32_t pid, int page_number);
+    void set(uint32_t pid, int page_number, int frame);
+    int erase(uint32_t pid, int page_number);
+    void eraseProcess(uint32_t pid, std::vector<int> &frames);
+    void entries(std::vector<PageMapEntry> &out);
+    size_t footprint();
+    int levels();
+};
+
+typedef struct RadixNode {
+    uint32_t used;                   // number of occupied slots
+    std::vector<RadixNode*> children; // interior levels
+    std::vector<int> frames;          // last level
+} RadixNode;
+
+// Multi-level radix tree per process over the page number bits of a 32-bit
+// virtual address. Levels are allocated on first use and freed once empty.
+class RadixPageMap : public PageMap {
+private:
+    int _levels;
+    int _shift[4]; // page number shift for each level
+    int _bits[4];  // index bits for each level
+    std::unordered_map<uint32_t, RadixNode*> _roots;
+    size_t _bytes;
+
+    uint32_t _last_pid;
+    RadixNode *_last_root;
+
+    RadixNode* newNode(int level);
+    void deleteNode(RadixNode *node, int level, std::vector<int> *frames);
+    void collect(RadixNode *node, int level, uint32_t pid, int page_prefix, std::vector<PageMapEntry> &out);
+    RadixNode* root(uint32_t pid);
+    int index(int page_number, int level);
+
+public:
+    RadixPageMap(int page_bits, int levels);
+    ~RadixPageMap();
+
+    int get(uint32_t pid, int page_number);
+    void set(uint32_t pid, int page_number, int frame);
+    int erase(uint32_t pid, int page_number);
+    void eraseProcess(uint32_t pid, std::vector<int> &frames);
+    void entries(std::vector<PageMapEntry> &out);
+    size_t footprint();
+    int levels();
+};
+
+typedef struct ConcurrentNode {
+    int level;
+    uint32_t used;                          // number of occupied slots, only touched by writers
+    std::atomic<ConcurrentNode*> *children; // interior levels
+    std::atomic<int> *frames;               // last level
+} ConcurrentNode;
+
+typedef std::unordered_map<uint32_t, ConcurrentNode*> ConcurrentRoots;
+
+typedef struct ConcurrentCounters {
+    uint64_t walks;
+    uint64_t levels_walked;
+    char padding[48]; // one reader per cache line
+} ConcurrentCounters;
+
+// Radix tree like RadixPageMap whose lookups take no locks while other
+// threads map and unmap pages. Writers are serialised by a lock and publish
+// new nodes with atomic stores. Unlinked nodes, and the pid -> root table
+// (copied whenever a process is added or removed), are freed through epoch
+// based reclamation once no lookup can still be reading them.
+class ConcurrentPageMap : public PageMap {
+private:
+    int _levels;
+    int _shift[4];
+    int _bits[4];
+    std::atomic<ConcurrentRoots*> _roots;
+    std::mutex _write_lock;
+    size_t _bytes;
+    ConcurrentCounters _counters[EPOCH_SLOTS]; // per epoch slot, summed by walks()
+    EpochDomain _epochs; // last, so retired nodes are freed while the members above still exist
+
+    ConcurrentNode* newNode(int level);
+    void deleteNode(ConcurrentNode *node, std::vector<int> *frames);
+    void collect(ConcurrentNode *node, uint32_t pid, int page_prefix, std::vector<PageMapEntry> &out);
+    void publishRoots(ConcurrentRoots *roots);
+    int index(int page_number, int level);
+
+    static void destroyNode(void *node, void *map);
+    static void destroyRoots(void *roots, void *map);
+
+public:
+    ConcurrentPageMap(int page_bits, int levels);
+    ~ConcurrentPageMap();
+
+    int get(uint32_t pid, int page_number);
+    void set(uint32_t pid, int page_number, int frame);
+    int erase(uint32_t pid, int page_number);
+    void eraseProcess(uint32_t pid, std::vector<int> &frames);
+    void entries(std::vector<PageMapEntry> &out);
+    size_t footprint();
+    int levels();
+    uint64_t walks();
+    uint64_t levelsWalked();
+};
+
+#endif // __PAGEMAP_H_
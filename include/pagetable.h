@@ -1,45 +1,142 @@
 #ifndef __PAGETABLE_H_
 #define __PAGETABLE_H_
 
+#include <cstdio>
 #include <iostream>
 #include <string>
 #include <vector>
-#include <map>
 #include <algorithm>
+#include <mutex>
+#include "frameallocator.h"
+#include "pagemap.h"
+#include "tlb.h"
+#include "replacer.h"
 
-struct PageTableKeyComparator
-{
-    inline bool operator() (const std::string& str1, const std::string& str2)
-    {
-        size_t sep1 = str1.find("|");
-        uint32_t pid1 = std::stoi(str1.substr(0, sep1));
-        int page1 = std::stoi(str1.substr(sep1 + 1));
-        size_t sep2 = str2.find("|");
-        uint32_t pid2 = std::stoi(str2.substr(0, sep2));
-        int page2 = std::stoi(str2.substr(sep2 + 1));
-
-        return (pid1 < pid2 || (pid1 == pid2 && page1 < page2));
-    }
-};
+class ImageWriter;
+class ImageReader;
+
+enum PageTableMode : uint8_t {Flat, Radix, Concurrent};
+
+// Larger page sizes, in log2 of base pages: 64 and 512 base pages
+#define LARGE_PAGE_SHIFT 6
+#define HUGE_PAGE_SHIFT 9
+
+typedef struct PagingStats {
+    uint64_t faults;     // translations that had to read the page back from swap
+    uint64_t evictions;  // pages written out to swap to make room
+    uint64_t zero_fills; // first writes to untouched pages
+    uint64_t cow_copies; // writes that had to copy a frame shared with another process
+} PagingStats;
 
 class PageTable {
 private:
-    
-    std::map<std::string, int> _table;
-    std::vector<std::string> sortedKeys();
+    PageMap *_map;
+    int _page_bits;
+    // Concurrent mode: getFrame() and getPhysicalAddress() take no locks
+    // while other threads call addEntry(), freeFrame() and freeProcessPages(),
+    // which are serialised by _write_lock. There is no TLB, paging or huge
+    // pages in this mode, since those update shared state on every translation.
+    bool _concurrent;
+    std::mutex _write_lock;
+    FrameAllocator *_frames; // shared by every shard
+    Tlb *_tlb; // NULL when disabled
+
+    // Demand paging, disabled while _replacer is NULL
+    PageReplacer *_replacer;
+    ReplacementPolicy _replacement_policy;
+    uint8_t *_memory;
+    int _frame_limit;
+    int _frames_held; // frames mapped by this page table, counting the zero frame
+    int _zero_frame; // always zero, mapped read-only by every untouched page
+    std::vector<std::vector<PageMapEntry> > _frame_owners; // pages mapped to each frame, shared copy-on-write if more than one
+    FILE *_swap;
+    FrameAllocator *_swap_slots;
+    bool _shared_memory; // frames, swap file and memory belong to another page table
+    std::vector<int> _slot_refs; // pages referencing each swap slot
+    std::unordered_map<uint32_t, std::unordered_map<int, int> > _swapped; // pid -> page -> swap slot
+    PagingStats _paging;
+    std::unordered_map<uint32_t, PagingStats> _process_paging;
+
+    // Large and huge pages: one translation for a run of contiguous frames.
+    // Keyed by pageKey(), they are never shared or swapped out; fork and
+    // partial frees split them back into base pages.
+    bool _huge_pages;
+    std::unordered_map<uint32_t, std::unordered_map<int, int> > _huge_map; // pid -> page key -> first frame
+    int _huge_mappings[2]; // live large and huge mappings
+
+    // Frames written or mapped, and swap slots written, since image
+    // _last_image was saved or loaded, one bit each, so checkpoints only
+    // copy those (see image.h)
+    std::vector<uint64_t> _dirty;
+    std::vector<uint64_t> _dirty_slots;
+    uint64_t _last_image;
+
+    int hugeFrame(uint32_t pid, int page_number, int *key);
+    void splitHugePage(uint32_t pid, int key);
+    void splitProcessHugePages(uint32_t pid);
+
+    int allocateFrame();
+    void mapFrame(uint32_t pid, int page_number, int frame);
+    void unmapFrame(uint32_t pid, int frame, std::vector<int> *released = NULL);
+    int evict();
+    int pageIn(uint32_t pid, int page_number);
+    int copyOnWrite(uint32_t pid, int page_number, int frame);
+    bool copyPages(uint32_t parent_pid, uint32_t child_pid);
+    void releaseSlot(int slot);
+    void markDirty(int frame);
+    void markSlotDirty(int slot);
+    void usedFrames(std::vector<int> &frames);
 
 public:
-    PageTable(int page_size);
+    PageTable(int page_size, PageTableMode mode = PageTableMode::Flat, int levels = 2);
     ~PageTable();
 
+    void enableTlb(int entries, int ways, TlbPolicy policy);
+    bool enablePaging(void *memory, int frames, ReplacementPolicy policy, const char *swap_path);
+    void enableHugePages();
+    void limitFrames(int frame_limit);
+    void useMemory(void *memory, int frames);
+    void shareMemory(PageTable *owner);
+
     int _page_size;
 
     void freeProcessPages(uint32_t pid);
     void freeFrame(uint32_t pid, int page_number);
+    // Returns the frame of a page, -1 if unmapped or -2 if it is swapped out
     int getFrame(uint32_t pid, int page_number);
+    // True if the page has a resident frame that no other page shares, so
+    // writing it takes no new frame and unmapping it frees one
+    bool ownsFrame(uint32_t pid, int page_number);
+    // True if the page reads as zeros without a frame of its own: unmapped,
+    // or mapped to the zero frame until its first write
+    bool zeroPage(uint32_t pid, int page_number);
     void addEntry(uint32_t pid, int page_number);
-    int getPhysicalAddress(uint32_t pid, uint32_t virtual_address);
+    void addRange(uint32_t pid, int first_page, int last_page);
+    bool forkPages(uint32_t parent_pid, uint32_t child_pid);
+    int getPhysicalAddress(uint32_t pid, uint32_t virtual_address, bool write = false);
     void print();
+    void printStats();
+
+    // Counters for the "stats" command
+    uint32_t framesInUse();
+    // Mapped pages (resident or swapped out) of every process, returns the total
+    uint32_t countPages(std::unordered_map<uint32_t, uint32_t> &pages);
+    PagingStats pagingStats();
+    PagingStats processPagingStats(uint32_t pid);
+
+    // Simulator images (see image.h). saveFrames() writes the frames and
+    // swap slots in use, or only those dirtied since lastImage(), and
+    // markClean() starts dirty tracking afresh once they are saved. Loading
+    // needs a page table without processes and takes the contents of each
+    // frame and slot it uses from `frames` and `slots`. Returns false,
+    // changing nothing, if one is missing or the frames don't fit in this
+    // page table's physical memory
+    void saveImage(ImageWriter &out);
+    void saveFrames(ImageWriter &out, bool dirty_only);
+    bool loadImage(ImageReader &in, const std::unordered_map<int, const uint8_t *> &frames,
+                   const std::unordered_map<int, const uint8_t *> &slots);
+    void markClean(uint64_t image_id);
+    uint64_t lastImage();
 };
 
-#endif // __PAGETABLE_H_
\ No newline at end of file
+#endif // __PAGETABLE_H_
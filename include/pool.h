@@ -0,0 +1,83 @@
+#ifndef __POOL_H_
+#define __POOL_H_
+
+#include <cstddef>
+#include <new>
+#include <vector>
+
+// Slab allocator for fixed-size records. Records are carved out of
+// contiguous chunks, and released records go on a free list to be reused by
+// the next allocate(). Destroying the pool frees every chunk at once without
+// running destructors of records that were never released, so records that
+// are not trivially destructible must be released first.
+template <typename T>
+class Pool {
+private:
+    std::vector<T*> _chunks;
+    std::vector<T*> _free;
+    size_t _chunk_size;
+    size_t _next; // next never-used slot in the last chunk
+    size_t _live;
+
+    Pool(const Pool&);
+    Pool& operator=(const Pool&);
+
+public:
+    Pool(size_t chunk_size = 64)
+    {
+        _chunk_size = chunk_size;
+        _next = chunk_size;
+        _live = 0;
+    }
+
+    ~Pool()
+    {
+        size_t i;
+        for (i = 0; i < _chunks.size(); i++)
+        {
+            ::operator delete(_chunks[i]);
+        }
+    }
+
+    T* allocate()
+    {
+        T *slot;
+        if (!_free.empty())
+        {
+            slot = _free.back();
+            _free.pop_back();
+        }
+        else
+        {
+            if (_next == _chunk_size)
+            {
+                _chunks.push_back((T*)::operator new(_chunk_size * sizeof(T)));
+                _next = 0;
+            }
+            slot = _chunks.back() + _next;
+            _next++;
+        }
+        _live++;
+        return new (slot) T();
+    }
+
+    void release(T *record)
+    {
+        record->~T();
+        _free.push_back(record);
+        _live--;
+    }
+
+    size_t live()
+    {
+        return _live;
+    }
+
+    // Bytes reserved by the pool's chunks
+    size_t capacity()
+    {
+        return _chunks.size() * _chunk_size * sizeof(T);
+    }
+};
+
+#endif // __POOL_H_
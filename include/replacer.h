@@ -0,0 +1,81 @@
+#ifndef __REPLACER_H_
+#define __REPLACER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+enum ReplacementPolicy : uint8_t {Fifo, LeastRecent, Clock, SecondChance, WorkingSet};
+
+// Chooses which resident frame to evict when physical memory is full.
+// Frames are numbered 0 to frames - 1.
+class PageReplacer {
+public:
+    virtual ~PageReplacer();
+
+    // A page was loaded into `frame`
+    virtual void insert(int frame) = 0;
+    // `frame` was referenced by a translation
+    virtual void access(int frame) = 0;
+    // `frame` was freed
+    virtual void remove(int frame) = 0;
+    // Picks a resident frame to evict and stops tracking it, -1 if none
+    virtual int victim() = 0;
+};
+
+// FIFO, LRU and second-chance keep resident frames in a list ordered by
+// load time (FIFO, second-chance) or last use (LRU). Second-chance gives a
+// referenced frame at the head of the list another trip around instead of
+// evicting it.
+class ListReplacer : public PageReplacer {
+private:
+    ReplacementPolicy _policy;
+    std::vector<int> _prev;
+    std::vector<int> _next;
+    std::vector<uint8_t> _referenced;
+    std::vector<uint8_t> _present;
+    int _head;
+    int _tail;
+
+    void unlink(int frame);
+    void append(int frame);
+
+public:
+    ListReplacer(int frames, ReplacementPolicy policy);
+    ~ListReplacer();
+
+    void insert(int frame);
+    void access(int frame);
+    void remove(int frame);
+    int victim();
+};
+
+// Clock sweeps a hand over the frames, clearing reference bits until it
+// finds an unreferenced frame. With a working-set window it also records the
+// virtual time (translation count) of each frame's last reference, and only
+// evicts unreferenced frames that have fallen out of the window, falling
+// back to the least recently used one when every frame is in the working set.
+class ClockReplacer : public PageReplacer {
+private:
+    std::vector<uint8_t> _referenced;
+    std::vector<uint8_t> _present;
+    std::vector<uint64_t> _last_use;
+    uint64_t _now;
+    uint64_t _window; // 0 for plain clock
+    int _hand;
+    int _resident;
+
+public:
+    ClockReplacer(int frames, uint64_t window = 0);
+    ~ClockReplacer();
+
+    void insert(int frame);
+    void access(int frame);
+    void remove(int frame);
+    int victim();
+};
+
+PageReplacer* createPageReplacer(ReplacementPolicy policy, int frames);
+const char* replacementPolicyName(ReplacementPolicy policy);
+
+#endif // __REPLACER_H_
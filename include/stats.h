@@ -0,0 +1,48 @@
+#ifndef __STATS_H_
+#define __STATS_H_
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+
+class Mmu;
+class PageTable;
+
+// Simulator operations whose latency is recorded
+enum SimOp : uint8_t {OpCreate, OpAllocate, OpSet, OpRead, OpFree, OpFork, OpTerminate, OpCompact, OpFill, OpCopy, OpCompare, OpCount};
+
+// Bucket i counts calls that took [2^i, 2^(i+1)) ns
+#define LATENCY_BUCKETS 40
+
+typedef struct LatencyHistogram {
+    uint64_t count;
+    uint64_t total_ns;
+    uint64_t max_ns;
+    uint64_t buckets[LATENCY_BUCKETS];
+} LatencyHistogram;
+
+void recordLatency(LatencyHistogram *histogram, uint64_t ns);
+// Upper bound of the bucket holding the `p` quantile, 0 if nothing was recorded
+uint64_t latencyPercentile(const LatencyHistogram *histogram, double p);
+const char* simOpName(SimOp op);
+
+// Records the time from construction to destruction as one call of `op`
+// in the latency histograms of an Mmu
+class OpTimer {
+private:
+    Mmu *_mmu;
+    SimOp _op;
+    std::chrono::steady_clock::time_point _start;
+
+public:
+    OpTimer(Mmu *mmu, SimOp op);
+    ~OpTimer();
+};
+
+enum StatsFormat : uint8_t {StatsText, StatsJson, StatsCsv};
+
+// Write the global and per-process counters of an Mmu and PageTable, and
+// the latency of every operation, for the "stats" command
+void writeStats(Mmu *mmu, PageTable *page_table, StatsFormat format, FILE *out);
+
+#endif // __STATS_H_
@@ -0,0 +1,51 @@
+#ifndef __TLB_H_
+#define __TLB_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+enum TlbPolicy : uint8_t {Lru, Random};
+
+typedef struct TlbEntry {
+    uint32_t pid;
+    int page_number;
+    int frame;
+    uint64_t last_used;
+    bool valid;
+} TlbEntry;
+
+// Set-associative translation lookaside buffer caching (pid, page) -> frame
+class Tlb {
+private:
+    int _sets;
+    int _ways;
+    TlbPolicy _policy;
+    std::vector<TlbEntry> _entries; // _sets groups of _ways entries
+    uint64_t _clock;
+    uint32_t _random_state;
+    uint64_t _hits;
+    uint64_t _misses;
+
+    int setIndex(uint32_t pid, int page_number);
+
+public:
+    Tlb(int entries, int ways, TlbPolicy policy);
+    ~Tlb();
+
+    // Returns the cached frame, or -1 on a miss. A miss is only counted if `count_miss`
+    // is set, so probing several page sizes counts as one lookup.
+    int lookup(uint32_t pid, int page_number, bool count_miss = true);
+    void insert(uint32_t pid, int page_number, int frame);
+    void invalidate(uint32_t pid, int page_number);
+    void invalidateProcess(uint32_t pid);
+    void flush();
+
+    int size();
+    int ways();
+    TlbPolicy policy();
+    uint64_t hits();
+    uint64_t misses();
+};
+
+#endif // __TLB_H_
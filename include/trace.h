@@ -0,0 +1,64 @@
+#ifndef __TRACE_H_
+#define __TRACE_H_
+
+#include <cstdint>
+#include <vector>
+#include "mmu.h"
+#include "pagetable.h"
+
+// Binary trace format
+//
+// A trace file is a TraceHeader followed by a stream of TraceEvents. Some
+// events carry a payload right after them, padded to a multiple of 4 bytes
+// so every event starts 4-byte aligned:
+//
+//   op             | a          | b          | c            | d            | payload
+//   ---------------+------------+------------+--------------+--------------+---------------------
+//   TraceName      | name id    | length     |              |              | name bytes
+//   TraceCreate    | text size  | data size  |              |              |
+//   TraceAllocate  | pid        | name id    | num elements |              |
+//   TraceSet       | pid        | name id    | offset       | value count  | values (type sized)
+//   TraceFree      | pid        | name id    |              |              |
+//   TraceTerminate | pid        |            |              |              |
+//   TraceRead      | pid        | name id    |              |              |
+//   TraceFork      | pid        |            |              |              |
+//
+// Variable names are defined once by a TraceName event and referenced by id
+// afterwards. `type` holds the DataType of allocate and set events.
+
+#define TRACE_MAGIC "MEMTRACE"
+#define TRACE_VERSION 1
+
+enum TraceOp : uint8_t {TraceName, TraceCreate, TraceAllocate, TraceSet, TraceFree, TraceTerminate, TraceRead, TraceFork};
+
+typedef struct TraceHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t event_count;
+} TraceHeader;
+
+typedef struct TraceEvent {
+    uint8_t op;
+    uint8_t type;
+    uint16_t reserved;
+    uint32_t a;
+    uint32_t b;
+    uint32_t c;
+    uint32_t d;
+} TraceEvent;
+
+// Convert a text command file into a binary trace, returns 0 on success
+int convertTrace(const char *text_path, const char *trace_path);
+// Memory-map a binary trace and run its events, returns 0 on success
+int replayTrace(const char *trace_path, Mmu *mmu, PageTable *page_table, void *memory);
+// Replay a trace on several shards at once, one worker thread per shard.
+// Shard i has mmus[i] and page_tables[i], the page tables sharing physical
+// memory (see PageTable::shareMemory), or all being one concurrent page
+// table. Every process, and every process forked from it, runs on one
+// shard, so the output of each process comes out in order but the output
+// of different processes is interleaved.
+// Returns 0 on success
+int replayTraceParallel(const char *trace_path, std::vector<Mmu *> &mmus, std::vector<PageTable *> &page_tables, void *memory);
+
+#endif // __TRACE_H_
@@ -0,0 +1,903 @@
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include "mmu.h"
+#include "pagetable.h"
+#include "memsim.h"
+
+// Microbenchmarks for the Mmu and PageTable hot paths
+//
+//   bin/bench [filter]
+//
+// Runs every benchmark whose name contains `filter` (all of them by default)
+// and prints one row per configuration: operations timed, mean ns/op, p50,
+// p90 and p99 ns/op, and heap allocations per operation. Cheap operations
+// are timed in batches of BATCH_SIZE so the clock doesn't dominate, the
+// percentiles are over those batches.
+
+#define BATCH_SIZE 32
+#define VIRTUAL_MEMORY_SIZE 67108864
+#define ALLOCATE_PAGE_SIZE 4096 // page size the Mmu accounts for in benchAllocate
+
+// Every heap allocation in the binary goes through here so each benchmark
+// can report allocations per operation
+static std::atomic<uint64_t> allocation_count(0);
+
+void* operator new(size_t size)
+{
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    void *p = malloc(size == 0 ? 1 : size);
+    if (p == NULL)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+// Keeps results of timed calls alive so the compiler can't drop them
+static volatile int sink;
+
+// xorshift32, fixed seed so every run does the same work
+static uint32_t random_state = 2463534242u;
+
+static uint32_t nextRandom()
+{
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return random_state;
+}
+
+enum SizeDistribution : uint8_t {Fixed, Uniform, Skewed};
+
+static const char* sizeDistributionName(SizeDistribution dist)
+{
+    switch (dist)
+    {
+        case SizeDistribution::Fixed:   return "fixed-64";
+        case SizeDistribution::Uniform: return "uniform-4k";
+        case SizeDistribution::Skewed:  return "skewed";
+    }
+    return "unknown";
+}
+
+// Allocation size in bytes: a fixed size, uniform up to 4 KB, or mostly
+// small objects with one in ten being a 4-64 KB array
+static uint32_t sampleSize(SizeDistribution dist)
+{
+    if (dist == SizeDistribution::Fixed)
+    {
+        return 64;
+    }
+    if (dist == SizeDistribution::Uniform)
+    {
+        return 1 + nextRandom() % 4096;
+    }
+    if (nextRandom() % 10 == 0)
+    {
+        return 4096 + nextRandom() % 61441;
+    }
+    return 8 + nextRandom() % 121;
+}
+
+class BenchRecorder {
+private:
+    std::vector<double> _samples; // ns/op of each timed batch
+    uint64_t _ops;
+    uint64_t _allocations;
+    double _total_ns;
+    std::chrono::steady_clock::time_point _start;
+    uint64_t _start_allocations;
+
+public:
+    BenchRecorder()
+    {
+        _ops = 0;
+        _allocations = 0;
+        _total_ns = 0;
+        _start_allocations = 0;
+    }
+
+    void start()
+    {
+        _start_allocations = allocation_count;
+        _start = std::chrono::steady_clock::now();
+    }
+
+    void stop(uint64_t ops)
+    {
+        std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+        double ns = std::chrono::duration<double, std::nano>(end - _start).count();
+        _allocations += allocation_count - _start_allocations;
+        _total_ns += ns;
+        _ops += ops;
+        if (ops > 0)
+        {
+            _samples.push_back(ns / ops);
+        }
+    }
+
+    // Add the batches timed by another recorder, e.g. of another thread
+    void merge(const BenchRecorder &other)
+    {
+        _samples.insert(_samples.end(), other._samples.begin(), other._samples.end());
+        _ops += other._ops;
+        _allocations += other._allocations;
+        _total_ns += other._total_ns;
+    }
+
+    void report(const char *name, const std::string &params)
+    {
+        if (_ops == 0)
+        {
+            printf("%-18s %-44s %10s\n", name, params.c_str(), "no ops");
+            return;
+        }
+        std::sort(_samples.begin(), _samples.end());
+        printf("%-18s %-44s %10llu %9.1f %9.1f %9.1f %9.1f %8.2f\n", name, params.c_str(),
+               (unsigned long long)_ops, _total_ns / _ops, percentile(0.50), percentile(0.90),
+               percentile(0.99), (double)_allocations / _ops);
+        fflush(stdout);
+    }
+
+    double meanNs()
+    {
+        return _ops > 0 ? _total_ns / _ops : 0;
+    }
+
+    double percentile(double p)
+    {
+        size_t index = (size_t)(p * (_samples.size() - 1));
+        return _samples[index];
+    }
+};
+
+static const char* pageTableModeName(PageTableMode mode)
+{
+    switch (mode)
+    {
+        case PageTableMode::Flat:       return "flat";
+        case PageTableMode::Radix:      return "radix";
+        case PageTableMode::Concurrent: return "concurrent";
+    }
+    return "unknown";
+}
+
+static PageTable* createPageTable(int page_size, PageTableMode mode)
+{
+    PageTable *page_table = new PageTable(page_size, mode, 2);
+    page_table->enableTlb(64, 4, TlbPolicy::Lru);
+    return page_table;
+}
+
+static std::string pageTableParams(int page_size, PageTableMode mode, int processes, int pages)
+{
+    char buffer[128];
+    snprintf(buffer, sizeof(buffer), "page=%d %s procs=%d pages=%d", page_size, pageTableModeName(mode), processes, pages);
+    return buffer;
+}
+
+// PageTable::addEntry, mapping `pages` pages into each of `processes` processes
+static void benchAddEntry(int page_size, PageTableMode mode, int processes, int pages)
+{
+    PageTable *page_table = createPageTable(page_size, mode);
+    BenchRecorder recorder;
+    int page;
+    int p;
+    for (page = 0; page < pages; page += BATCH_SIZE)
+    {
+        for (p = 0; p < processes; p++)
+        {
+            int last = std::min(page + BATCH_SIZE, pages);
+            int i;
+            recorder.start();
+            for (i = page; i < last; i++)
+            {
+                page_table->addEntry(1024 + p, i);
+            }
+            recorder.stop(last - page);
+        }
+    }
+    recorder.report("addEntry", pageTableParams(page_size, mode, processes, pages));
+    delete page_table;
+}
+
+// PageTable::getPhysicalAddress over mapped pages, either walking each
+// process's memory sequentially or jumping to random processes and pages
+static void benchTranslate(int page_size, PageTableMode mode, int processes, int pages, bool sequential, int ops)
+{
+    PageTable *page_table = createPageTable(page_size, mode);
+    int page;
+    int p;
+    for (p = 0; p < processes; p++)
+    {
+        for (page = 0; page < pages; page++)
+        {
+            page_table->addEntry(1024 + p, page);
+        }
+    }
+
+    uint32_t span = (uint32_t)pages * page_size;
+    std::vector<uint32_t> pid_list(BATCH_SIZE);
+    std::vector<uint32_t> address_list(BATCH_SIZE);
+    uint32_t address = 0;
+    uint32_t pid = 1024;
+    BenchRecorder recorder;
+    int done;
+    for (done = 0; done < ops; done += BATCH_SIZE)
+    {
+        int i;
+        for (i = 0; i < BATCH_SIZE; i++)
+        {
+            if (sequential)
+            {
+                address += 4;
+                if (address >= span)
+                {
+                    address = 0;
+                    pid = 1024 + (pid - 1024 + 1) % processes;
+                }
+                pid_list[i] = pid;
+                address_list[i] = address;
+            }
+            else
+            {
+                pid_list[i] = 1024 + nextRandom() % processes;
+                address_list[i] = nextRandom() % span;
+            }
+        }
+        recorder.start();
+        for (i = 0; i < BATCH_SIZE; i++)
+        {
+            sink = page_table->getPhysicalAddress(pid_list[i], address_list[i]);
+        }
+        recorder.stop(BATCH_SIZE);
+    }
+    std::string params = pageTableParams(page_size, mode, processes, pages) + (sequential ? " seq" : " random");
+    recorder.report("getPhysicalAddr", params);
+    delete page_table;
+}
+
+// PageTable::freeProcessPages, one call per process with `pages` pages mapped
+static void benchFreeProcessPages(int page_size, PageTableMode mode, int processes, int pages)
+{
+    PageTable *page_table = createPageTable(page_size, mode);
+    int page;
+    int p;
+    for (p = 0; p < processes; p++)
+    {
+        for (page = 0; page < pages; page++)
+        {
+            page_table->addEntry(1024 + p, page);
+        }
+    }
+    BenchRecorder recorder;
+    for (p = 0; p < processes; p++)
+    {
+        recorder.start();
+        page_table->freeProcessPages(1024 + p);
+        recorder.stop(1);
+    }
+    recorder.report("freeProcessPages", pageTableParams(page_size, mode, processes, pages));
+    delete page_table;
+}
+
+// writeVariable and readVariable on an int array of `elements` elements,
+// `chunk` elements per call, reported per element copied
+static void benchBulkCopy(int page_size, uint32_t elements, uint32_t chunk)
+{
+    Mmu *mmu = new Mmu(VIRTUAL_MEMORY_SIZE, page_size);
+    PageTable *page_table = createPageTable(page_size, PageTableMode::Flat);
+    uint32_t size = elements * sizeof(int);
+    void *memory = malloc(size + page_size);
+    uint32_t pid = mmu->createProcess();
+    int address = mmu->findFreeSpace(pid, size);
+    mmu->addVariableToProcess(pid, "array", DataType::Int, size, address);
+    int page;
+    for (page = address / page_size; page <= (address + size - 1) / page_size; page++)
+    {
+        page_table->addEntry(pid, page);
+    }
+
+    std::vector<int> values(chunk);
+    uint32_t i;
+    for (i = 0; i < chunk; i++)
+    {
+        values[i] = i;
+    }
+    BenchRecorder write_recorder;
+    BenchRecorder read_recorder;
+    int pass;
+    for (pass = 0; pass < 4; pass++)
+    {
+        uint32_t offset;
+        for (offset = 0; offset + chunk <= elements; offset += chunk)
+        {
+            write_recorder.start();
+            writeVariable<int>(pid, "array", offset, values.data(), chunk, mmu, page_table, memory);
+            write_recorder.stop(chunk);
+        }
+        for (offset = 0; offset + chunk <= elements; offset += chunk)
+        {
+            read_recorder.start();
+            readVariable<int>(pid, "array", offset, values.data(), chunk, mmu, page_table, memory);
+            read_recorder.stop(chunk);
+        }
+    }
+
+    char buffer[128];
+    snprintf(buffer, sizeof(buffer), "page=%d elements=%u chunk=%u", page_size, elements, chunk);
+    write_recorder.report("writeVariable", buffer);
+    read_recorder.report("readVariable", buffer);
+    free(memory);
+    delete page_table;
+    delete mmu;
+}
+
+static void reportSpeedup(const char *name, const std::string &params, BenchRecorder &baseline, BenchRecorder &recorder)
+{
+    printf("%-18s %-44s %9.1fx\n", name, params.c_str(), baseline.meanNs() / recorder.meanNs());
+    fflush(stdout);
+}
+
+// fill, copy and cmp of whole int arrays against doing the same with set
+// commands and element reads and writes, reported per element
+static void benchBulkOps(int page_size, uint32_t elements)
+{
+    Mmu *mmu = new Mmu(VIRTUAL_MEMORY_SIZE, page_size);
+    PageTable *page_table = createPageTable(page_size, PageTableMode::Flat);
+    uint32_t size = elements * sizeof(int);
+    const char *names[] = {"a", "b", "c"};
+    void *memory = malloc(3 * (size + page_size) + page_size);
+    uint32_t pid = mmu->createProcess();
+    int v;
+    for (v = 0; v < 3; v++)
+    {
+        int address = mmu->findFreeSpace(pid, size);
+        mmu->addVariableToProcess(pid, names[v], DataType::Int, size, address);
+        int page;
+        for (page = address / page_size; page <= (address + size - 1) / page_size; page++)
+        {
+            if (page_table->getFrame(pid, page) == -1)
+            {
+                page_table->addEntry(pid, page);
+            }
+        }
+    }
+
+    // A set command of 64 values, as a script initialising the array would use
+    std::vector<const char *> tokens(64, "7");
+    std::vector<int> first(elements);
+    std::vector<int> second(elements);
+    BenchRecorder set_recorder;
+    BenchRecorder fill_recorder;
+    BenchRecorder read_write_recorder;
+    BenchRecorder copy_recorder;
+    BenchRecorder read_compare_recorder;
+    BenchRecorder compare_recorder;
+    int pass;
+    for (pass = 0; pass < 4; pass++)
+    {
+        set_recorder.start();
+        uint32_t offset;
+        for (offset = 0; offset + tokens.size() <= elements; offset += tokens.size())
+        {
+            setVariable(pid, "a", offset, tokens, 0, mmu, page_table, memory);
+        }
+        set_recorder.stop(offset);
+
+        fill_recorder.start();
+        fillVariable(pid, "a", "7", mmu, page_table, memory);
+        fill_recorder.stop(elements);
+
+        read_write_recorder.start();
+        readVariable<int>(pid, "a", 0, first.data(), elements, mmu, page_table, memory);
+        writeVariable<int>(pid, "b", 0, first.data(), elements, mmu, page_table, memory);
+        read_write_recorder.stop(elements);
+
+        copy_recorder.start();
+        copyVariable(pid, "a", "c", mmu, page_table, memory);
+        copy_recorder.stop(elements);
+
+        read_compare_recorder.start();
+        readVariable<int>(pid, "b", 0, first.data(), elements, mmu, page_table, memory);
+        readVariable<int>(pid, "c", 0, second.data(), elements, mmu, page_table, memory);
+        uint32_t i;
+        for (i = 0; i < elements && first[i] == second[i]; i++)
+        {
+        }
+        sink = i;
+        read_compare_recorder.stop(elements);
+
+        compare_recorder.start();
+        uint32_t element;
+        sink = compareVariables(pid, "b", "c", &element, mmu, page_table, memory);
+        compare_recorder.stop(elements);
+    }
+
+    char buffer[128];
+    snprintf(buffer, sizeof(buffer), "page=%d elements=%u", page_size, elements);
+    set_recorder.report("setVariable", buffer);
+    fill_recorder.report("fillVariable", buffer);
+    reportSpeedup("fill speedup", buffer, set_recorder, fill_recorder);
+    read_write_recorder.report("read+writeVariable", buffer);
+    copy_recorder.report("copyVariable", buffer);
+    reportSpeedup("copy speedup", buffer, read_write_recorder, copy_recorder);
+    read_compare_recorder.report("read+compare", buffer);
+    compare_recorder.report("compareVariables", buffer);
+    reportSpeedup("cmp speedup", buffer, read_compare_recorder, compare_recorder);
+    free(memory);
+    delete page_table;
+    delete mmu;
+}
+
+// freeVariable of an array spanning `pages` pages, in a process that also
+// holds `variables` small variables, reported per page of the array
+static void benchFreeVariable(int page_size, int variables, int pages)
+{
+    Mmu *mmu = new Mmu(VIRTUAL_MEMORY_SIZE, page_size);
+    PageTable *page_table = createPageTable(page_size, PageTableMode::Flat);
+    uint32_t pid = mmu->createProcess();
+    int i;
+    for (i = 0; i < variables; i++)
+    {
+        int address = mmu->findFreeSpace(pid, 16);
+        mmu->addVariableToProcess(pid, "v" + std::to_string(i), DataType::Char, 16, address);
+        page_table->addRange(pid, address / page_size, (address + 15) / page_size);
+    }
+
+    BenchRecorder recorder;
+    uint32_t size = (uint32_t)pages * page_size;
+    for (i = 0; i < 32; i++)
+    {
+        int address = mmu->findFreeSpace(pid, size);
+        mmu->addVariableToProcess(pid, "array", DataType::Char, size, address);
+        page_table->addRange(pid, address / page_size, (address + size - 1) / page_size);
+        recorder.start();
+        freeVariable(pid, "array", mmu, page_table);
+        recorder.stop(pages);
+    }
+
+    char buffer[128];
+    snprintf(buffer, sizeof(buffer), "page=%d vars=%d pages=%d", page_size, variables, pages);
+    recorder.report("freeVariable", buffer);
+    delete page_table;
+    delete mmu;
+}
+
+// xorshift32 with a state of its own, for threads
+static uint32_t nextRandom(uint32_t *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+#define STRESS_PROCESSES 8
+#define STRESS_PAGES 1024
+#define STRESS_CHURN_PAGE (1 << 14) // first page mapped and unmapped by the writers
+
+// Lookup-only threads of the concurrent translation stress test: translate
+// pages that are never unmapped, checking them against the frames recorded
+// before the writers started, and pages the writers map and unmap, which
+// must translate to nothing or to an address of a frame in use
+static void stressReader(PageTable *page_table, const std::vector<int> *reference, int page_size, int ops,
+                         uint32_t seed, BenchRecorder *recorder, uint64_t *mismatches)
+{
+    uint32_t state = seed;
+    std::vector<uint32_t> pid_list(BATCH_SIZE);
+    std::vector<uint32_t> address_list(BATCH_SIZE);
+    std::vector<int> results(BATCH_SIZE);
+    int done;
+    for (done = 0; done < ops; done += BATCH_SIZE)
+    {
+        int i;
+        for (i = 0; i < BATCH_SIZE; i++)
+        {
+            int page = nextRandom(&state) % STRESS_PAGES;
+            if (i % 4 == 3)
+            {
+                page += STRESS_CHURN_PAGE;
+            }
+            pid_list[i] = 1024 + nextRandom(&state) % STRESS_PROCESSES;
+            address_list[i] = (uint32_t)page * page_size + nextRandom(&state) % page_size;
+        }
+        recorder->start();
+        for (i = 0; i < BATCH_SIZE; i++)
+        {
+            results[i] = page_table->getPhysicalAddress(pid_list[i], address_list[i]);
+        }
+        recorder->stop(BATCH_SIZE);
+        for (i = 0; i < BATCH_SIZE; i++)
+        {
+            int page = address_list[i] / page_size;
+            int offset = address_list[i] % page_size;
+            if (page < STRESS_PAGES)
+            {
+                int frame = reference[pid_list[i] - 1024][page];
+                if (results[i] != frame * page_size + offset)
+                {
+                    (*mismatches)++;
+                }
+            }
+            else if (results[i] != -1 && (results[i] < 0 || results[i] % page_size != offset))
+            {
+                (*mismatches)++;
+            }
+        }
+    }
+}
+
+// Mapping and unmapping threads: each one maps and unmaps pages of its own
+// above STRESS_CHURN_PAGE in every process, and maps and frees whole
+// processes of its own, until `stop` is set
+static void stressWriter(PageTable *page_table, int writer, uint32_t seed, std::atomic<bool> *stop, uint64_t *updates)
+{
+    uint32_t state = seed;
+    uint32_t own_pid = 4096 + writer;
+    while (!stop->load())
+    {
+        uint32_t pid = 1024 + nextRandom(&state) % STRESS_PROCESSES;
+        // Pages far enough apart to need leaf nodes of their own
+        int page = STRESS_CHURN_PAGE + (writer * 64 + nextRandom(&state) % 64) * 4096;
+        if (page_table->getFrame(pid, page) < 0)
+        {
+            page_table->addEntry(pid, page);
+        }
+        else
+        {
+            page_table->freeFrame(pid, page);
+        }
+        if (nextRandom(&state) % 64 == 0)
+        {
+            int i;
+            for (i = 0; i < 64; i++)
+            {
+                page_table->addEntry(own_pid, i * 4096);
+            }
+            page_table->freeProcessPages(own_pid);
+        }
+        (*updates)++;
+    }
+}
+
+// PageTable::getPhysicalAddress in concurrent mode with `readers` threads
+// translating while `writers` threads map and unmap pages. Returns false if
+// any translation didn't match the serial reference
+static bool stressConcurrentTranslate(int page_size, int readers, int writers, int ops)
+{
+    PageTable *page_table = new PageTable(page_size, PageTableMode::Concurrent, 2);
+    std::vector<int> reference[STRESS_PROCESSES];
+    int p;
+    int page;
+    for (p = 0; p < STRESS_PROCESSES; p++)
+    {
+        for (page = 0; page < STRESS_PAGES; page++)
+        {
+            page_table->addEntry(1024 + p, page);
+            reference[p].push_back(page_table->getFrame(1024 + p, page));
+        }
+    }
+
+    std::vector<BenchRecorder> recorders(readers);
+    std::vector<uint64_t> mismatches(readers, 0);
+    std::vector<uint64_t> updates(writers, 0);
+    std::vector<std::thread> reader_threads;
+    std::vector<std::thread> writer_threads;
+    std::atomic<bool> stop(false);
+    int i;
+    for (i = 0; i < writers; i++)
+    {
+        writer_threads.push_back(std::thread(stressWriter, page_table, i, 1234567u + i, &stop, &updates[i]));
+    }
+    for (i = 0; i < readers; i++)
+    {
+        reader_threads.push_back(std::thread(stressReader, page_table, reference, page_size, ops, 7654321u + i,
+                                             &recorders[i], &mismatches[i]));
+    }
+    for (i = 0; i < readers; i++)
+    {
+        reader_threads[i].join();
+    }
+    stop.store(true);
+    for (i = 0; i < writers; i++)
+    {
+        writer_threads[i].join();
+    }
+
+    // Nothing the writers did may have disturbed the untouched pages
+    uint64_t total_mismatches = 0;
+    for (p = 0; p < STRESS_PROCESSES; p++)
+    {
+        for (page = 0; page < STRESS_PAGES; page++)
+        {
+            if (page_table->getFrame(1024 + p, page) != reference[p][page])
+            {
+                total_mismatches++;
+            }
+        }
+    }
+    uint64_t total_updates = 0;
+    for (i = 0; i < writers; i++)
+    {
+        total_updates += updates[i];
+    }
+    BenchRecorder recorder;
+    for (i = 0; i < readers; i++)
+    {
+        recorder.merge(recorders[i]);
+        total_mismatches += mismatches[i];
+    }
+
+    // Allocations per op include the writers'
+    char buffer[128];
+    snprintf(buffer, sizeof(buffer), "page=%d readers=%d writers=%d updates=%llu", page_size, readers, writers,
+             (unsigned long long)total_updates);
+    recorder.report("concurrentTranslate", buffer);
+    if (total_mismatches > 0)
+    {
+        printf("concurrentTranslate: %llu translations didn't match the serial reference\n",
+               (unsigned long long)total_mismatches);
+    }
+    delete page_table;
+    return total_mismatches == 0;
+}
+
+typedef struct BenchVariable {
+    uint32_t pid;
+    int name;
+} BenchVariable;
+
+// Mmu::findFreeSpace and Mmu::mergeFreeSpace in steady state: each process
+// is filled with `variables` variables, then batches of random variables are
+// freed and the same number allocated again
+static void benchAllocate(AllocPolicy policy, SizeDistribution dist, int processes, int variables, int ops)
+{
+    Mmu *mmu = new Mmu(VIRTUAL_MEMORY_SIZE, ALLOCATE_PAGE_SIZE, policy);
+    std::vector<std::string> names(variables);
+    int i;
+    for (i = 0; i < variables; i++)
+    {
+        names[i] = "v" + std::to_string(i);
+    }
+
+    std::vector<BenchVariable> live;
+    std::vector<BenchVariable> dead;
+    int p;
+    for (p = 0; p < processes; p++)
+    {
+        uint32_t pid = mmu->createProcess();
+        for (i = 0; i < variables; i++)
+        {
+            BenchVariable v = {pid, i};
+            dead.push_back(v);
+        }
+    }
+
+    BenchRecorder find_recorder;
+    BenchRecorder merge_recorder;
+    std::vector<uint32_t> sizes(BATCH_SIZE);
+    std::vector<int> addresses(BATCH_SIZE);
+    std::vector<Variable*> victims(BATCH_SIZE);
+    std::vector<BenchVariable> batch;
+    bool filling = true;
+    int done = 0;
+    while (done < ops)
+    {
+        // Free a batch of random live variables (not while filling up)
+        if (!filling && !live.empty())
+        {
+            batch.clear();
+            for (i = 0; i < BATCH_SIZE && !live.empty(); i++)
+            {
+                int k = nextRandom() % live.size();
+                batch.push_back(live[k]);
+                live[k] = live.back();
+                live.pop_back();
+                victims[i] = mmu->getVariable(batch[i].pid, names[batch[i].name]);
+            }
+            merge_recorder.start();
+            for (i = 0; i < batch.size(); i++)
+            {
+                mmu->mergeFreeSpace(batch[i].pid, victims[i]);
+            }
+            merge_recorder.stop(batch.size());
+            dead.insert(dead.end(), batch.begin(), batch.end());
+        }
+
+        // Allocate a batch of random dead variables
+        batch.clear();
+        for (i = 0; i < BATCH_SIZE && !dead.empty(); i++)
+        {
+            int k = nextRandom() % dead.size();
+            batch.push_back(dead[k]);
+            dead[k] = dead.back();
+            dead.pop_back();
+            sizes[i] = sampleSize(dist);
+        }
+        if (!filling)
+        {
+            find_recorder.start();
+        }
+        for (i = 0; i < batch.size(); i++)
+        {
+            addresses[i] = mmu->findFreeSpace(batch[i].pid, sizes[i]);
+        }
+        if (!filling)
+        {
+            find_recorder.stop(batch.size());
+            done += batch.size();
+        }
+        bool failed = false;
+        for (i = 0; i < batch.size(); i++)
+        {
+            if (addresses[i] < 0)
+            {
+                failed = true;
+                dead.push_back(batch[i]);
+                continue;
+            }
+            mmu->addVariableToProcess(batch[i].pid, names[batch[i].name], DataType::Char, sizes[i], addresses[i]);
+            live.push_back(batch[i]);
+        }
+        if (dead.empty() || batch.empty() || failed)
+        {
+            filling = false;
+        }
+    }
+
+    char buffer[128];
+    snprintf(buffer, sizeof(buffer), "%s %s procs=%d vars=%d", allocPolicyName(policy),
+             sizeDistributionName(dist), processes, variables);
+    find_recorder.report("findFreeSpace", buffer);
+    merge_recorder.report("mergeFreeSpace", buffer);
+    delete mmu;
+}
+
+static bool selected(const char *filter, const char *name)
+{
+    return filter == NULL || strstr(name, filter) != NULL;
+}
+
+int main(int argc, char **argv)
+{
+    const char *filter = argc > 1 ? argv[1] : NULL;
+    int page_sizes[] = {256, 1024, 4096};
+    PageTableMode modes[] = {PageTableMode::Flat, PageTableMode::Radix};
+    int s;
+    int m;
+
+    printf("%-18s %-44s %10s %9s %9s %9s %9s %8s\n", "benchmark", "parameters", "ops", "ns/op", "p50", "p90", "p99", "allocs");
+
+    if (selected(filter, "addEntry"))
+    {
+        int process_counts[] = {1, 64};
+        int p;
+        for (m = 0; m < 2; m++)
+        {
+            for (s = 0; s < 3; s++)
+            {
+                for (p = 0; p < 2; p++)
+                {
+                    benchAddEntry(page_sizes[s], modes[m], process_counts[p], 4096);
+                }
+            }
+        }
+    }
+
+    if (selected(filter, "getPhysicalAddr"))
+    {
+        int process_counts[] = {1, 64};
+        int p;
+        for (m = 0; m < 2; m++)
+        {
+            for (s = 1; s < 3; s++)
+            {
+                for (p = 0; p < 2; p++)
+                {
+                    benchTranslate(page_sizes[s], modes[m], process_counts[p], 4096, true, 1 << 20);
+                    benchTranslate(page_sizes[s], modes[m], process_counts[p], 4096, false, 1 << 20);
+                }
+            }
+        }
+    }
+
+    if (selected(filter, "findFreeSpace") || selected(filter, "mergeFreeSpace"))
+    {
+        int variable_counts[] = {256, 4096};
+        int p;
+        int d;
+        int v;
+        for (p = AllocPolicy::FirstFit; p <= AllocPolicy::Buddy; p++)
+        {
+            for (d = SizeDistribution::Fixed; d <= SizeDistribution::Skewed; d++)
+            {
+                for (v = 0; v < 2; v++)
+                {
+                    benchAllocate((AllocPolicy)p, (SizeDistribution)d, 4, variable_counts[v], 1 << 17);
+                }
+            }
+        }
+    }
+
+    if (selected(filter, "writeVariable") || selected(filter, "readVariable"))
+    {
+        uint32_t chunks[] = {1, 64, 1 << 20};
+        int c;
+        for (s = 1; s < 3; s++)
+        {
+            for (c = 0; c < 3; c++)
+            {
+                benchBulkCopy(page_sizes[s], 1 << 20, chunks[c]);
+            }
+        }
+    }
+
+    if (selected(filter, "fillVariable") || selected(filter, "copyVariable") || selected(filter, "compareVariables"))
+    {
+        for (s = 1; s < 3; s++)
+        {
+            benchBulkOps(page_sizes[s], 1 << 20);
+        }
+    }
+
+    if (selected(filter, "freeVariable"))
+    {
+        int variable_counts[] = {16, 4096};
+        int page_counts[] = {16, 1024};
+        int v;
+        int p;
+        for (v = 0; v < 2; v++)
+        {
+            for (p = 0; p < 2; p++)
+            {
+                benchFreeVariable(4096, variable_counts[v], page_counts[p]);
+            }
+        }
+    }
+
+    if (selected(filter, "freeProcessPages"))
+    {
+        int page_counts[] = {64, 1024};
+        int p;
+        for (m = 0; m < 2; m++)
+        {
+            for (s = 1; s < 3; s++)
+            {
+                for (p = 0; p < 2; p++)
+                {
+                    benchFreeProcessPages(page_sizes[s], modes[m], 256, page_counts[p]);
+                }
+            }
+        }
+    }
+
+    if (selected(filter, "concurrentTranslate"))
+    {
+        int reader_counts[] = {1, 4};
+        int r;
+        for (r = 0; r < 2; r++)
+        {
+            if (!stressConcurrentTranslate(1024, reader_counts[r], 0, 1 << 20) ||
+                !stressConcurrentTranslate(1024, reader_counts[r], 2, 1 << 20))
+            {
+                return 1;
+            }
+        }
+    }
+
+    return 0;
+}
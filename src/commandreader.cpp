@@ -0,0 +1,99 @@
+#include "commandreader.h"
+#include <cstring>
+#include <iostream>
+
+#define READ_BLOCK_SIZE (1 << 20)
+
+CommandReader::CommandReader(FILE *file)
+{
+    _file = file;
+    _start = 0;
+    _end = 0;
+    _eof = false;
+    if (_file != NULL)
+    {
+        // One extra byte so an unterminated last line can be null-terminated
+        _buffer.resize(READ_BLOCK_SIZE + 1);
+    }
+}
+
+CommandReader::~CommandReader()
+{
+}
+
+char* CommandReader::nextLine()
+{
+    if (_file == NULL)
+    {
+        if (!std::getline(std::cin, _line))
+        {
+            return NULL;
+        }
+        if (!_line.empty() && _line[_line.size() - 1] == '\r')
+        {
+            _line.erase(_line.size() - 1);
+        }
+        return &_line[0];
+    }
+
+    while (1)
+    {
+        char *start = &_buffer[_start];
+        char *newline = (char *)memchr(start, '\n', _end - _start);
+        if (newline != NULL || (_eof && _start < _end))
+        {
+            char *line_end = newline != NULL ? newline : &_buffer[_end];
+            if (line_end > start && line_end[-1] == '\r')
+            {
+                line_end[-1] = '\0';
+            }
+            *line_end = '\0';
+            _start = newline != NULL ? (newline - &_buffer[0]) + 1 : _end;
+            return start;
+        }
+        if (_eof)
+        {
+            return NULL;
+        }
+
+        // Move the partial line to the front and read the next block after it,
+        // growing the buffer if a single line doesn't fit
+        size_t partial = _end - _start;
+        memmove(&_buffer[0], &_buffer[_start], partial);
+        _start = 0;
+        _end = partial;
+        if (_buffer.size() - 1 - _end < READ_BLOCK_SIZE / 2)
+        {
+            _buffer.resize(_buffer.size() + READ_BLOCK_SIZE);
+        }
+        size_t count = fread(&_buffer[_end], 1, _buffer.size() - 1 - _end, _file);
+        _end += count;
+        if (count == 0)
+        {
+            _eof = true;
+        }
+    }
+}
+
+void splitCommand(char *command, std::vector<const char *> &tokens)
+{
+    tokens.clear();
+    char *c = command;
+    while (*c != '\0')
+    {
+        while (*c == ' ' || *c == '\t' || *c == '\r')
+        {
+            *c = '\0';
+            c++;
+        }
+        if (*c == '\0')
+        {
+            break;
+        }
+        tokens.push_back(c);
+        while (*c != '\0' && *c != ' ' && *c != '\t' && *c != '\r')
+        {
+            c++;
+        }
+    }
+}
@@ -0,0 +1,107 @@
+#include "epoch.h"
+
+// Slot each thread tries first, spread so that threads rarely share one
+static std::atomic<int> next_thread_slot(0);
+static thread_local int thread_slot = -1;
+
+EpochDomain::EpochDomain()
+{
+    _epoch.store(1);
+    int i;
+    for (i = 0; i < EPOCH_SLOTS; i++)
+    {
+        _slots[i].epoch.store(0);
+    }
+}
+
+EpochDomain::~EpochDomain()
+{
+    int i;
+    for (i = 0; i < _retired.size(); i++)
+    {
+        _retired[i].destroy(_retired[i].object, _retired[i].context);
+    }
+}
+
+int EpochDomain::enter()
+{
+    if (thread_slot < 0)
+    {
+        thread_slot = next_thread_slot.fetch_add(1) % EPOCH_SLOTS;
+    }
+    int slot = thread_slot;
+    while (true)
+    {
+        // The exchange is sequentially consistent, so either a writer that
+        // unlinks an object after it sees this reader, or the reader sees
+        // the object unlinked
+        uint64_t free_slot = 0;
+        if (_slots[slot].epoch.compare_exchange_strong(free_slot, _epoch.load()))
+        {
+            return slot;
+        }
+        slot = (slot + 1) % EPOCH_SLOTS;
+    }
+}
+
+void EpochDomain::exit(int slot)
+{
+    _slots[slot].epoch.store(0, std::memory_order_release);
+}
+
+void EpochDomain::retire(void *object, void (*destroy)(void *object, void *context), void *context)
+{
+    EpochRetired retired = {object, destroy, context, _epoch.load()};
+    _retired.push_back(retired);
+    // Readers that enter from now on can't reach the object
+    _epoch.fetch_add(1);
+    if (_retired.size() >= EPOCH_RECLAIM_BATCH)
+    {
+        reclaim();
+    }
+}
+
+// Destroy the retired objects that every reader still inside entered after
+void EpochDomain::reclaim()
+{
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    uint64_t oldest = UINT64_MAX;
+    int i;
+    for (i = 0; i < EPOCH_SLOTS; i++)
+    {
+        uint64_t epoch = _slots[i].epoch.load();
+        if (epoch != 0 && epoch < oldest)
+        {
+            oldest = epoch;
+        }
+    }
+    size_t kept = 0;
+    for (i = 0; i < _retired.size(); i++)
+    {
+        if (_retired[i].epoch < oldest)
+        {
+            _retired[i].destroy(_retired[i].object, _retired[i].context);
+        }
+        else
+        {
+            _retired[kept++] = _retired[i];
+        }
+    }
+    _retired.resize(kept);
+}
+
+EpochGuard::EpochGuard(EpochDomain *domain)
+{
+    _domain = domain;
+    _slot = domain->enter();
+}
+
+EpochGuard::~EpochGuard()
+{
+    _domain->exit(_slot);
+}
+
+int EpochGuard::slot()
+{
+    return _slot;
+}
@@ -0,0 +1,140 @@
+#include "frameallocator.h"
+
+FrameAllocator::FrameAllocator()
+{
+    _first_summary = 0;
+    _used = 0;
+}
+
+FrameAllocator::~FrameAllocator()
+{
+}
+
+// Returns the lowest free frame and marks it as used
+int FrameAllocator::allocate()
+{
+    std::lock_guard<std::mutex> guard(_lock);
+    // Skip summary words whose bitmap words are all full
+    while (_first_summary < _summary.size() && ~_summary[_first_summary] == 0)
+    {
+        _first_summary++;
+    }
+    // Every frame handed out so far is in use, grow by one summary word (4096 frames)
+    if (_first_summary == _summary.size())
+    {
+        _summary.push_back(0);
+        _bitmap.resize(_summary.size() * 64, 0);
+    }
+
+    size_t word = _first_summary * 64 + __builtin_ctzll(~_summary[_first_summary]);
+    int bit = __builtin_ctzll(~_bitmap[word]);
+    _bitmap[word] |= (1ULL << bit);
+    if (~_bitmap[word] == 0)
+    {
+        _summary[word / 64] |= (1ULL << (word % 64));
+    }
+    _used++;
+
+    return (int)(word * 64 + bit);
+}
+
+int FrameAllocator::allocateRun(int count, int limit)
+{
+    std::lock_guard<std::mutex> guard(_lock);
+    size_t words = count / 64;
+    size_t word;
+    // Bitmap words past the end are free
+    for (word = 0; (word + words) * 64 <= (size_t)limit; word += words)
+    {
+        size_t w;
+        for (w = word; w < word + words && (w >= _bitmap.size() || _bitmap[w] == 0); w++)
+        {
+        }
+        if (w < word + words)
+        {
+            continue;
+        }
+        if ((word + words + 63) / 64 > _summary.size())
+        {
+            _summary.resize((word + words + 63) / 64, 0);
+            _bitmap.resize(_summary.size() * 64, 0);
+        }
+        for (w = word; w < word + words; w++)
+        {
+            _bitmap[w] = ~0ULL;
+            _summary[w / 64] |= (1ULL << (w % 64));
+        }
+        _used += count;
+        return (int)(word * 64);
+    }
+    return -1;
+}
+
+void FrameAllocator::reserve(int frame)
+{
+    std::lock_guard<std::mutex> guard(_lock);
+    if (isUsed(frame))
+    {
+        return;
+    }
+    size_t word = frame / 64;
+    if (word / 64 >= _summary.size())
+    {
+        _summary.resize(word / 64 + 1, 0);
+        _bitmap.resize(_summary.size() * 64, 0);
+    }
+    _bitmap[word] |= (1ULL << (frame % 64));
+    if (~_bitmap[word] == 0)
+    {
+        _summary[word / 64] |= (1ULL << (word % 64));
+    }
+    _used++;
+}
+
+// Returns a frame to the allocator
+void FrameAllocator::free(int frame)
+{
+    std::lock_guard<std::mutex> guard(_lock);
+    release(frame);
+}
+
+void FrameAllocator::freeFrames(const std::vector<int> &frames)
+{
+    std::lock_guard<std::mutex> guard(_lock);
+    int i;
+    for (i = 0; i < frames.size(); i++)
+    {
+        release(frames[i]);
+    }
+}
+
+// Clears the bit of a frame, the caller holds the lock
+void FrameAllocator::release(int frame)
+{
+    if (!isUsed(frame))
+    {
+        return;
+    }
+    size_t word = frame / 64;
+    _bitmap[word] &= ~(1ULL << (frame % 64));
+    _summary[word / 64] &= ~(1ULL << (word % 64));
+    if (word / 64 < _first_summary)
+    {
+        _first_summary = word / 64;
+    }
+    _used--;
+}
+
+bool FrameAllocator::isUsed(int frame)
+{
+    if (frame < 0 || frame / 64 >= _bitmap.size())
+    {
+        return false;
+    }
+    return (_bitmap[frame / 64] >> (frame % 64)) & 1;
+}
+
+uint32_t FrameAllocator::framesInUse()
+{
+    return _used;
+}
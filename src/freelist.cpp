@@ -0,0 +1,599 @@
+#include "freelist.h"
+#include "image.h"
+#include <cstring>
+
+// floor(log2(size)) for size > 0
+static int sizeClass(uint32_t size)
+{
+    return 31 - __builtin_clz(size);
+}
+
+// ceil(log2(size)) for size > 0
+static int sizeOrder(uint32_t size)
+{
+    int order = sizeClass(size);
+    if ((size & (size - 1)) != 0)
+    {
+        order++;
+    }
+    return order;
+}
+
+FitTree::FitTree()
+{
+    _root = -1;
+    _seed = 2463534242u;
+}
+
+// Recompute the largest block under a node from its children
+void FitTree::update(int node)
+{
+    FitNode &n = _nodes[node];
+    n.max_size = n.size;
+    if (n.left >= 0 && _nodes[n.left].max_size > n.max_size)
+    {
+        n.max_size = _nodes[n.left].max_size;
+    }
+    if (n.right >= 0 && _nodes[n.right].max_size > n.max_size)
+    {
+        n.max_size = _nodes[n.right].max_size;
+    }
+}
+
+// Split the subtree at `node` into the blocks below `address` and the rest
+void FitTree::split(int node, uint32_t address, int *left, int *right)
+{
+    if (node < 0)
+    {
+        *left = -1;
+        *right = -1;
+        return;
+    }
+    if (_nodes[node].address < address)
+    {
+        split(_nodes[node].right, address, &_nodes[node].right, right);
+        *left = node;
+    }
+    else
+    {
+        split(_nodes[node].left, address, left, &_nodes[node].left);
+        *right = node;
+    }
+    update(node);
+}
+
+// Join two subtrees, every block of `left` lying below every block of `right`
+int FitTree::merge(int left, int right)
+{
+    if (left < 0 || right < 0)
+    {
+        return left >= 0 ? left : right;
+    }
+    if (_nodes[left].priority > _nodes[right].priority)
+    {
+        _nodes[left].right = merge(_nodes[left].right, right);
+        update(left);
+        return left;
+    }
+    _nodes[right].left = merge(left, _nodes[right].left);
+    update(right);
+    return right;
+}
+
+void FitTree::insert(uint32_t address, uint32_t size)
+{
+    int left;
+    int middle;
+    int right;
+    split(_root, address, &left, &right);
+    split(right, address + 1, &middle, &right);
+    if (middle < 0)
+    {
+        if (!_free_nodes.empty())
+        {
+            middle = _free_nodes.back();
+            _free_nodes.pop_back();
+        }
+        else
+        {
+            middle = _nodes.size();
+            _nodes.push_back(FitNode());
+        }
+        // xorshift32
+        _seed ^= _seed << 13;
+        _seed ^= _seed >> 17;
+        _seed ^= _seed << 5;
+        _nodes[middle].priority = _seed;
+    }
+    _nodes[middle].address = address;
+    _nodes[middle].size = size;
+    _nodes[middle].left = -1;
+    _nodes[middle].right = -1;
+    update(middle);
+    _root = merge(merge(left, middle), right);
+}
+
+// Give the block at `address` a new address and size, which must keep it
+// between its neighbours. Walks down to it and fixes the maxima on the way back
+void FitTree::resize(uint32_t address, uint32_t new_address, uint32_t new_size)
+{
+    _path.clear();
+    int node = _root;
+    while (node >= 0 && _nodes[node].address != address)
+    {
+        _path.push_back(node);
+        node = address < _nodes[node].address ? _nodes[node].left : _nodes[node].right;
+    }
+    if (node < 0)
+    {
+        return;
+    }
+    _nodes[node].address = new_address;
+    _nodes[node].size = new_size;
+    update(node);
+    int i;
+    for (i = (int)_path.size() - 1; i >= 0; i--)
+    {
+        update(_path[i]);
+    }
+}
+
+void FitTree::erase(uint32_t address)
+{
+    int left;
+    int middle;
+    int right;
+    split(_root, address, &left, &right);
+    split(right, address + 1, &middle, &right);
+    if (middle >= 0)
+    {
+        _free_nodes.push_back(middle);
+    }
+    _root = merge(left, right);
+}
+
+// Only subtrees holding a large enough block are entered, and only those on
+// the path to `from` can fail once entered, so this is O(depth)
+int FitTree::find(int node, uint32_t size, uint32_t from)
+{
+    if (node < 0 || _nodes[node].max_size < size)
+    {
+        return -1;
+    }
+    const FitNode &n = _nodes[node];
+    if (n.address >= from)
+    {
+        int found = find(n.left, size, from);
+        if (found >= 0)
+        {
+            return found;
+        }
+        if (n.size >= size)
+        {
+            return n.address;
+        }
+    }
+    return find(n.right, size, from);
+}
+
+int FitTree::lowestFit(uint32_t size, uint32_t from)
+{
+    return find(_root, size, from);
+}
+
+FreeList::FreeList(uint32_t size, AllocPolicy policy)
+{
+    _policy = policy;
+    _size = size;
+    _free_bytes = 0;
+    _requested_bytes = 0;
+    _reserved_bytes = 0;
+    _rover = 0;
+    memset(_size_classes, 0, sizeof(_size_classes));
+    _classes.resize(32);
+    _class_mask = 0;
+    _max_order = 0;
+
+    if (size == 0)
+    {
+        return;
+    }
+    if (_policy == AllocPolicy::Buddy)
+    {
+        // Cover the address space with the largest aligned power-of-two blocks
+        _max_order = sizeClass(size);
+        _buddy_free.resize(_max_order + 1);
+        uint32_t address = 0;
+        uint32_t remaining = size;
+        while (remaining > 0)
+        {
+            int order = sizeClass(remaining);
+            while (address % (1u << order) != 0)
+            {
+                order--;
+            }
+            _buddy_free[order].insert(address);
+            insertBlock(address, 1u << order);
+            address += 1u << order;
+            remaining -= 1u << order;
+        }
+    }
+    else
+    {
+        insertBlock(0, size);
+    }
+}
+
+FreeList::~FreeList()
+{
+}
+
+// Add a free block to, or remove it from, every index but the fit tree
+void FreeList::indexBlock(uint32_t address, uint32_t size, bool add)
+{
+    if (add)
+    {
+        _by_address[address] = size;
+        _by_size.insert(std::make_pair(size, address));
+        _free_bytes += size;
+        _size_classes[sizeClass(size)]++;
+    }
+    else
+    {
+        _by_address.erase(address);
+        _by_size.erase(std::make_pair(size, address));
+        _free_bytes -= size;
+        _size_classes[sizeClass(size)]--;
+    }
+    if (_policy == AllocPolicy::Segregated)
+    {
+        int c = sizeClass(size);
+        if (add)
+        {
+            _classes[c].insert(address);
+            _class_mask |= (1ULL << c);
+        }
+        else
+        {
+            _classes[c].erase(address);
+            if (_classes[c].empty())
+            {
+                _class_mask &= ~(1ULL << c);
+            }
+        }
+    }
+}
+
+void FreeList::insertBlock(uint32_t address, uint32_t size)
+{
+    indexBlock(address, size, true);
+    if (_policy == AllocPolicy::FirstFit || _policy == AllocPolicy::NextFit)
+    {
+        _fits.insert(address, size);
+    }
+}
+
+void FreeList::removeBlock(uint32_t address, uint32_t size)
+{
+    indexBlock(address, size, false);
+    if (_policy == AllocPolicy::FirstFit || _policy == AllocPolicy::NextFit)
+    {
+        _fits.erase(address);
+    }
+}
+
+// Move the ends of a free block without passing a neighbouring block, so it
+// keeps its place in the fit tree and is updated there in place
+void FreeList::resizeBlock(uint32_t address, uint32_t size, uint32_t new_address, uint32_t new_size)
+{
+    indexBlock(address, size, false);
+    indexBlock(new_address, new_size, true);
+    if (_policy == AllocPolicy::FirstFit || _policy == AllocPolicy::NextFit)
+    {
+        _fits.resize(address, new_address, new_size);
+    }
+}
+
+// Carve `size` bytes off the low end of a free block
+void FreeList::takeFromBlock(uint32_t block_address, uint32_t block_size, uint32_t size)
+{
+    if (block_size > size)
+    {
+        resizeBlock(block_address, block_size, block_address + size, block_size - size);
+    }
+    else
+    {
+        removeBlock(block_address, block_size);
+    }
+}
+
+int FreeList::allocate(uint32_t size)
+{
+    if (_by_address.empty())
+    {
+        return -1;
+    }
+    // Empty allocations take no space, they sit at the lowest free address
+    if (size == 0)
+    {
+        return _by_address.begin()->first;
+    }
+    if (_policy == AllocPolicy::Buddy)
+    {
+        return allocateBuddy(size);
+    }
+
+    bool found = false;
+    uint32_t block_address = 0;
+    uint32_t block_size = 0;
+
+    if (_policy == AllocPolicy::FirstFit || _policy == AllocPolicy::NextFit)
+    {
+        // Next-fit resumes from where the previous allocation ended and wraps around
+        int address = _fits.lowestFit(size, _policy == AllocPolicy::NextFit ? _rover : 0);
+        if (address < 0 && _policy == AllocPolicy::NextFit)
+        {
+            address = _fits.lowestFit(size, 0);
+        }
+        if (address >= 0)
+        {
+            found = true;
+            block_address = address;
+            block_size = _by_address[block_address];
+        }
+    }
+    else if (_policy == AllocPolicy::WorstFit)
+    {
+        std::set<std::pair<uint32_t, uint32_t> >::reverse_iterator it = _by_size.rbegin();
+        if (it->first >= size)
+        {
+            found = true;
+            block_size = it->first;
+            block_address = it->second;
+        }
+    }
+    else
+    {
+        // Segregated fit: any block of the first non-empty class at or above
+        // ceil(log2(size)) is large enough, so take its lowest-address block
+        if (_policy == AllocPolicy::Segregated)
+        {
+            int order = sizeOrder(size);
+            uint64_t candidates = order < 64 ? _class_mask & (~0ULL << order) : 0;
+            if (candidates != 0)
+            {
+                int c = __builtin_ctzll(candidates);
+                found = true;
+                block_address = *_classes[c].begin();
+                block_size = _by_address[block_address];
+            }
+        }
+        // Best fit (also the fallback for a segregated request that only fits
+        // a block from its own, partially smaller, size class)
+        if (!found)
+        {
+            std::set<std::pair<uint32_t, uint32_t> >::iterator it = _by_size.lower_bound(std::make_pair(size, (uint32_t)0));
+            if (it != _by_size.end())
+            {
+                found = true;
+                block_size = it->first;
+                block_address = it->second;
+            }
+        }
+    }
+
+    if (!found)
+    {
+        return -1;
+    }
+    takeFromBlock(block_address, block_size, size);
+    _requested_bytes += size;
+    _reserved_bytes += size;
+    _rover = block_address + size;
+    return block_address;
+}
+
+int FreeList::release(uint32_t address, uint32_t size)
+{
+    if (size == 0)
+    {
+        return 0;
+    }
+    if (_policy == AllocPolicy::Buddy)
+    {
+        _requested_bytes -= size;
+        return releaseBuddy(address);
+    }
+    _requested_bytes -= size;
+    _reserved_bytes -= size;
+
+    // Coalesce with the free blocks directly after and before, growing one
+    // of them in place
+    std::map<uint32_t, uint32_t>::iterator next = _by_address.lower_bound(address);
+    bool has_next = next != _by_address.end() && next->first == address + size;
+    std::map<uint32_t, uint32_t>::iterator prev = next;
+    bool has_prev = prev != _by_address.begin() && (--prev)->first + prev->second == address;
+    if (has_prev && has_next)
+    {
+        uint32_t next_size = next->second;
+        removeBlock(next->first, next_size);
+        resizeBlock(prev->first, prev->second, prev->first, prev->second + size + next_size);
+        return 2;
+    }
+    if (has_prev)
+    {
+        resizeBlock(prev->first, prev->second, prev->first, prev->second + size);
+        return 1;
+    }
+    if (has_next)
+    {
+        resizeBlock(next->first, next->second, address, size + next->second);
+        return 1;
+    }
+    insertBlock(address, size);
+    return 0;
+}
+
+int FreeList::allocateBuddy(uint32_t size)
+{
+    int order = sizeOrder(size);
+    int k = order;
+    while (k <= _max_order && _buddy_free[k].empty())
+    {
+        k++;
+    }
+    if (k > _max_order)
+    {
+        return -1;
+    }
+
+    uint32_t address = *_buddy_free[k].begin();
+    _buddy_free[k].erase(_buddy_free[k].begin());
+    removeBlock(address, 1u << k);
+
+    // Split down to the requested order, freeing the upper halves
+    while (k > order)
+    {
+        k--;
+        uint32_t buddy = address + (1u << k);
+        _buddy_free[k].insert(buddy);
+        insertBlock(buddy, 1u << k);
+    }
+
+    _buddy_allocated[address] = order;
+    _requested_bytes += size;
+    _reserved_bytes += 1u << order;
+    return address;
+}
+
+int FreeList::releaseBuddy(uint32_t address)
+{
+    std::unordered_map<uint32_t, int>::iterator it = _buddy_allocated.find(address);
+    if (it == _buddy_allocated.end())
+    {
+        return 0;
+    }
+    int order = it->second;
+    _buddy_allocated.erase(it);
+    _reserved_bytes -= 1u << order;
+
+    // Merge with the buddy as long as it is free
+    int merged = 0;
+    while (order < _max_order)
+    {
+        uint32_t buddy = address ^ (1u << order);
+        std::set<uint32_t>::iterator b = _buddy_free[order].find(buddy);
+        if (b == _buddy_free[order].end())
+        {
+            break;
+        }
+        _buddy_free[order].erase(b);
+        removeBlock(buddy, 1u << order);
+        if (buddy < address)
+        {
+            address = buddy;
+        }
+        order++;
+        merged++;
+    }
+    _buddy_free[order].insert(address);
+    insertBlock(address, 1u << order);
+    return merged;
+}
+
+AllocPolicy FreeList::policy()
+{
+    return _policy;
+}
+
+FragmentationMetrics FreeList::metrics()
+{
+    FragmentationMetrics m;
+    m.free_bytes = _free_bytes;
+    m.free_blocks = _by_address.size();
+    m.largest_free_block = _by_size.empty() ? 0 : _by_size.rbegin()->first;
+    m.internal_bytes = _reserved_bytes - _requested_bytes;
+    m.external_fragmentation = _free_bytes > 0 ? 1.0 - (double)m.largest_free_block / _free_bytes : 0.0;
+    memcpy(m.size_classes, _size_classes, sizeof(m.size_classes));
+    return m;
+}
+
+void FreeList::saveImage(ImageWriter &out)
+{
+    out.put<uint32_t>(_requested_bytes);
+    out.put<uint32_t>(_reserved_bytes);
+    out.put<uint32_t>(_rover);
+    out.put<uint32_t>(_by_address.size());
+    std::map<uint32_t, uint32_t>::iterator block;
+    for (block = _by_address.begin(); block != _by_address.end(); block++)
+    {
+        out.put<uint32_t>(block->first);
+        out.put<uint32_t>(block->second);
+    }
+    out.put<uint32_t>(_buddy_allocated.size());
+    std::unordered_map<uint32_t, int>::iterator live;
+    for (live = _buddy_allocated.begin(); live != _buddy_allocated.end(); live++)
+    {
+        out.put<uint32_t>(live->first);
+        out.put<int32_t>(live->second);
+    }
+}
+
+bool FreeList::loadImage(ImageReader &in)
+{
+    while (!_by_address.empty())
+    {
+        removeBlock(_by_address.begin()->first, _by_address.begin()->second);
+    }
+    int i;
+    for (i = 0; i < _buddy_free.size(); i++)
+    {
+        _buddy_free[i].clear();
+    }
+    _buddy_allocated.clear();
+
+    _requested_bytes = in.get<uint32_t>();
+    _reserved_bytes = in.get<uint32_t>();
+    _rover = in.get<uint32_t>();
+    uint32_t blocks = in.get<uint32_t>();
+    uint32_t b;
+    for (b = 0; b < blocks && in.ok(); b++)
+    {
+        uint32_t address = in.get<uint32_t>();
+        uint32_t size = in.get<uint32_t>();
+        if (size == 0 || (uint64_t)address + size > _size)
+        {
+            return false;
+        }
+        insertBlock(address, size);
+        if (_policy == AllocPolicy::Buddy)
+        {
+            if ((size & (size - 1)) != 0 || sizeClass(size) > _max_order)
+            {
+                return false;
+            }
+            _buddy_free[sizeClass(size)].insert(address);
+        }
+    }
+    uint32_t live = in.get<uint32_t>();
+    for (b = 0; b < live && in.ok(); b++)
+    {
+        uint32_t address = in.get<uint32_t>();
+        _buddy_allocated[address] = in.get<int32_t>();
+    }
+    return in.ok();
+}
+
+const char* allocPolicyName(AllocPolicy policy)
+{
+    switch (policy)
+    {
+        case AllocPolicy::FirstFit:   return "first-fit";
+        case AllocPolicy::NextFit:    return "next-fit";
+        case AllocPolicy::BestFit:    return "best-fit";
+        case AllocPolicy::WorstFit:   return "worst-fit";
+        case AllocPolicy::Segregated: return "segregated";
+        case AllocPolicy::Buddy:      return "buddy";
+    }
+    return "unknown";
+}
@@ -0,0 +1,296 @@
+#include "image.h"
+#include "memsim.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+
+ImageWriter::ImageWriter(FILE *file)
+{
+    _file = file;
+    _ok = true;
+}
+
+void ImageWriter::write(const void *data, size_t size)
+{
+    if (size > 0 && fwrite(data, 1, size, _file) != size)
+    {
+        _ok = false;
+    }
+}
+
+void ImageWriter::writeString(const std::string &string)
+{
+    put<uint32_t>(string.size());
+    write(string.data(), string.size());
+}
+
+bool ImageWriter::ok()
+{
+    return _ok;
+}
+
+ImageReader::ImageReader(const uint8_t *data, size_t size)
+{
+    _data = data;
+    _size = size;
+    _offset = 0;
+    _ok = true;
+}
+
+bool ImageReader::read(void *data, size_t size)
+{
+    const uint8_t *bytes = take(size);
+    if (bytes == NULL)
+    {
+        memset(data, 0, size);
+        return false;
+    }
+    memcpy(data, bytes, size);
+    return true;
+}
+
+void ImageReader::seek(size_t offset)
+{
+    if (offset > _size)
+    {
+        _ok = false;
+        return;
+    }
+    _offset = offset;
+}
+
+const uint8_t* ImageReader::take(size_t size)
+{
+    if (!_ok || size > _size - _offset)
+    {
+        _ok = false;
+        return NULL;
+    }
+    const uint8_t *bytes = _data + _offset;
+    _offset += size;
+    return bytes;
+}
+
+std::string ImageReader::readString()
+{
+    uint32_t size = get<uint32_t>();
+    const uint8_t *bytes = take(size);
+    return bytes != NULL ? std::string((const char *)bytes, size) : std::string();
+}
+
+bool ImageReader::ok()
+{
+    return _ok;
+}
+
+// Images are told apart by the time they were saved at, made unique
+static uint64_t newImageId(PageTable *page_table)
+{
+    uint64_t id = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    return std::max(id, page_table->lastImage() + 1);
+}
+
+static bool writeImage(const char *path, Mmu *mmu, PageTable *page_table, uint32_t memory_size, bool checkpoint)
+{
+    FILE *file = fopen(path, "wb");
+    if (file == NULL)
+    {
+        fprintf(stderr, "error: can't create '%s'\n", path);
+        return false;
+    }
+    ImageHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, IMAGE_MAGIC, sizeof(header.magic));
+    header.version = IMAGE_VERSION;
+    header.page_size = page_table->_page_size;
+    header.memory_size = memory_size;
+    header.id = newImageId(page_table);
+    header.parent = checkpoint ? page_table->lastImage() : 0;
+
+    ImageWriter out(file);
+    out.put(header);
+    mmu->saveImage(out);
+    page_table->saveImage(out);
+    // The header is written again once the frame section is known to start here
+    long frames_offset = ftell(file);
+    page_table->saveFrames(out, header.parent != 0);
+    header.frames_offset = frames_offset;
+    bool ok = frames_offset >= 0 && fseek(file, 0, SEEK_SET) == 0;
+    out.put(header);
+    ok = ok && out.ok();
+    if (fclose(file) != 0)
+    {
+        ok = false;
+    }
+    if (!ok)
+    {
+        fprintf(stderr, "error: can't write '%s'\n", path);
+        return false;
+    }
+    page_table->markClean(header.id);
+    return true;
+}
+
+bool saveImage(const char *path, Mmu *mmu, PageTable *page_table, uint32_t memory_size)
+{
+    return writeImage(path, mmu, page_table, memory_size, false);
+}
+
+bool saveCheckpoint(const char *path, Mmu *mmu, PageTable *page_table, uint32_t memory_size)
+{
+    return writeImage(path, mmu, page_table, memory_size, page_table->lastImage() != 0);
+}
+
+// Terminate every live process
+static void terminateAll(Mmu *mmu, PageTable *page_table)
+{
+    std::vector<uint32_t> pids;
+    mmu->processIds(pids);
+    int i;
+    for (i = 0; i < pids.size(); i++)
+    {
+        terminateProcess(pids[i], mmu, page_table);
+    }
+}
+
+typedef struct MappedImage {
+    const uint8_t *data;
+    size_t length;
+    ImageHeader header;
+} MappedImage;
+
+// Map an image file and check that it was saved by a simulator like this
+// one, returns false after printing the error otherwise
+static bool mapImage(const char *path, PageTable *page_table, uint32_t memory_size, MappedImage *image)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        fprintf(stderr, "error: can't open '%s'\n", path);
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < sizeof(ImageHeader))
+    {
+        fprintf(stderr, "error: '%s' is not an image file\n", path);
+        close(fd);
+        return false;
+    }
+    image->length = st.st_size;
+    // Frames are copied straight out of the mapping, so an image is never
+    // read as a whole, only the frames that are in use when it's loaded
+    image->data = (const uint8_t *)mmap(NULL, image->length, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (image->data == MAP_FAILED)
+    {
+        fprintf(stderr, "error: can't map '%s'\n", path);
+        return false;
+    }
+    memcpy(&image->header, image->data, sizeof(ImageHeader));
+    const ImageHeader &header = image->header;
+    bool ok = false;
+    if (memcmp(header.magic, IMAGE_MAGIC, sizeof(header.magic)) != 0 || header.version != IMAGE_VERSION)
+    {
+        fprintf(stderr, "error: '%s' is not an image file\n", path);
+    }
+    else if (header.page_size != page_table->_page_size || header.memory_size != memory_size)
+    {
+        fprintf(stderr, "error: image was saved with a page size of %u bytes and %llu bytes of memory\n",
+                header.page_size, (unsigned long long)header.memory_size);
+    }
+    else if (header.frames_offset < sizeof(ImageHeader) || header.frames_offset > image->length)
+    {
+        fprintf(stderr, "error: '%s' is truncated\n", path);
+    }
+    else
+    {
+        ok = true;
+    }
+    if (!ok)
+    {
+        munmap((void *)image->data, image->length);
+    }
+    return ok;
+}
+
+// One list of the frame section: a count, then numbered pages
+static void readContents(ImageReader &in, uint32_t page_size, std::unordered_map<int, const uint8_t *> &contents)
+{
+    uint32_t count = in.get<uint32_t>();
+    uint32_t i;
+    for (i = 0; i < count && in.ok(); i++)
+    {
+        int number = in.get<int32_t>();
+        contents[number] = in.take(page_size);
+    }
+}
+
+bool loadImage(const std::vector<const char *> &paths, Mmu *mmu, PageTable *page_table, uint32_t memory_size)
+{
+    std::vector<MappedImage> images;
+    bool ok = true;
+    int i;
+    for (i = 0; i < paths.size() && ok; i++)
+    {
+        MappedImage image;
+        ok = mapImage(paths[i], page_table, memory_size, &image);
+        if (!ok)
+        {
+            break;
+        }
+        // A chain starts with a full image, each checkpoint follows its parent
+        images.push_back(image);
+        uint64_t parent = i > 0 ? images[i - 1].header.id : 0;
+        if (image.header.parent != parent)
+        {
+            fprintf(stderr, i == 0 ? "error: '%s' is a checkpoint, load the image it builds on first\n" :
+                    "error: '%s' is not a checkpoint of the image before it\n", paths[i]);
+            ok = false;
+        }
+    }
+
+    // Contents of each frame and swap slot, from the newest image holding it
+    std::unordered_map<int, const uint8_t *> frames;
+    std::unordered_map<int, const uint8_t *> slots;
+    for (i = 0; i < images.size() && ok; i++)
+    {
+        ImageReader in(images[i].data, images[i].length);
+        in.seek(images[i].header.frames_offset);
+        readContents(in, page_table->_page_size, frames);
+        readContents(in, page_table->_page_size, slots);
+        if (!in.ok())
+        {
+            fprintf(stderr, "error: '%s' is truncated\n", paths[i]);
+            ok = false;
+        }
+    }
+
+    if (ok)
+    {
+        MappedImage &last = images.back();
+        ImageReader in(last.data, last.header.frames_offset);
+        in.seek(sizeof(ImageHeader));
+        terminateAll(mmu, page_table);
+        ok = mmu->loadImage(in) && page_table->loadImage(in, frames, slots);
+        if (ok)
+        {
+            page_table->markClean(last.header.id);
+        }
+        else
+        {
+            terminateAll(mmu, page_table);
+            fprintf(stderr, "error: can't load '%s'\n", paths.back());
+        }
+    }
+    for (i = 0; i < images.size(); i++)
+    {
+        munmap((void *)images[i].data, images[i].length);
+    }
+    return ok;
+}
@@ -4,18 +4,15 @@
 #include <cmath>
 #include "mmu.h"
 #include "pagetable.h"
+#include "commandreader.h"
+#include "memsim.h"
+#include "trace.h"
+#include "stats.h"
+#include "image.h"
 
-void printStartMessage(int page_size);
-void createProcess(int text_size, int data_size, Mmu *mmu, PageTable *page_table);
-void allocateVariable(uint32_t pid, std::string var_name, DataType type, uint32_t num_elements, Mmu *mmu, PageTable *page_table);
-void setVariable(uint32_t pid, std::string var_name, uint32_t offset, void *value, Mmu *mmu, PageTable *page_table, void *memory);
-void freeVariable(uint32_t pid, std::string var_name, Mmu *mmu, PageTable *page_table);
-void terminateProcess(uint32_t pid, Mmu *mmu, PageTable *page_table);
-bool stringToIntTest(std::string input);
-bool pidExists(int pid);
-
-std::vector<int> pids;
+#define OUTPUT_BUFFER_SIZE (1 << 20)
 
+void printStartMessage(int page_size);
 int main(int argc, char **argv)
 {
     // Ensure user specified page size as a command line parameter
@@ -27,46 +24,321 @@ int main(int argc, char **argv)
 
     // Print opening instuction message
     int page_size = std::stoi(argv[1]);
-    printStartMessage(page_size);
+
+    // Optional settings following the page size
+    PageTableMode page_table_mode = PageTableMode::Flat;
+    int page_table_levels = 2;
+    int tlb_entries = 64;
+    int tlb_ways = 4;
+    TlbPolicy tlb_policy = TlbPolicy::Lru;
+    AllocPolicy alloc_policy = AllocPolicy::FirstFit;
+    bool batch = false;
+    const char *batch_path = NULL;
+    const char *replay_path = NULL;
+    int frame_limit = 0;
+    ReplacementPolicy replacement_policy = ReplacementPolicy::Clock;
+    const char *swap_path = NULL;
+    bool huge_pages = false;
+    int threads = 1;
+    int compact_threshold = -1;
+    bool concurrent = false;
+    bool paging_options = false;
+    int arg;
+    for (arg = 2; arg < argc; arg++)
+    {
+        if (strcmp(argv[arg], "--radix") == 0 && arg + 1 < argc && stringToIntTest(argv[arg + 1]))
+        {
+            page_table_mode = PageTableMode::Radix;
+            page_table_levels = std::stoi(argv[++arg]);
+            if (page_table_levels < 2 || page_table_levels > 4)
+            {
+                fprintf(stderr, "Error: radix page table must have 2, 3 or 4 levels\n");
+                return 1;
+            }
+        }
+        else if (strcmp(argv[arg], "--concurrent") == 0)
+        {
+            // Lock-free translations on one page table shared by every replay thread
+            concurrent = true;
+        }
+        else if (strcmp(argv[arg], "--tlb") == 0 && arg + 1 < argc && stringToIntTest(argv[arg + 1]))
+        {
+            tlb_entries = std::stoi(argv[++arg]);
+        }
+        else if (strcmp(argv[arg], "--tlb-ways") == 0 && arg + 1 < argc && stringToIntTest(argv[arg + 1]))
+        {
+            tlb_ways = std::stoi(argv[++arg]);
+        }
+        else if (strcmp(argv[arg], "--tlb-policy") == 0 && arg + 1 < argc)
+        {
+            arg++;
+            if (strcmp(argv[arg], "lru") == 0)
+            {
+                tlb_policy = TlbPolicy::Lru;
+            }
+            else if (strcmp(argv[arg], "random") == 0)
+            {
+                tlb_policy = TlbPolicy::Random;
+            }
+            else
+            {
+                fprintf(stderr, "Error: TLB policy must be 'lru' or 'random'\n");
+                return 1;
+            }
+        }
+        else if (strcmp(argv[arg], "--alloc") == 0 && arg + 1 < argc)
+        {
+            arg++;
+            int p;
+            for (p = AllocPolicy::FirstFit; p <= AllocPolicy::Buddy; p++)
+            {
+                if (strcmp(argv[arg], allocPolicyName((AllocPolicy)p)) == 0)
+                {
+                    alloc_policy = (AllocPolicy)p;
+                    break;
+                }
+            }
+            if (p > AllocPolicy::Buddy)
+            {
+                fprintf(stderr, "Error: allocation policy must be first-fit, next-fit, best-fit, worst-fit, segregated or buddy\n");
+                return 1;
+            }
+        }
+        else if (strcmp(argv[arg], "--frames") == 0 && arg + 1 < argc && stringToIntTest(argv[arg + 1]))
+        {
+            frame_limit = std::stoi(argv[++arg]);
+            paging_options = true;
+        }
+        else if (strcmp(argv[arg], "--replace") == 0 && arg + 1 < argc)
+        {
+            arg++;
+            int p;
+            for (p = ReplacementPolicy::Fifo; p <= ReplacementPolicy::WorkingSet; p++)
+            {
+                if (strcmp(argv[arg], replacementPolicyName((ReplacementPolicy)p)) == 0)
+                {
+                    replacement_policy = (ReplacementPolicy)p;
+                    break;
+                }
+            }
+            if (p > ReplacementPolicy::WorkingSet)
+            {
+                fprintf(stderr, "Error: replacement policy must be fifo, lru, clock, second-chance or working-set\n");
+                return 1;
+            }
+            paging_options = true;
+        }
+        else if (strcmp(argv[arg], "--swap") == 0 && arg + 1 < argc)
+        {
+            swap_path = argv[++arg];
+            paging_options = true;
+        }
+        else if (strcmp(argv[arg], "--huge-pages") == 0)
+        {
+            huge_pages = true;
+            paging_options = true;
+        }
+        else if (strcmp(argv[arg], "--compact") == 0 && arg + 1 < argc && stringToIntTest(argv[arg + 1]))
+        {
+            // Compact a process after a free leaves more than this percent of its page space unused
+            compact_threshold = std::stoi(argv[++arg]);
+            if (compact_threshold > 100)
+            {
+                fprintf(stderr, "Error: compaction threshold must be a percentage\n");
+                return 1;
+            }
+        }
+        else if (strcmp(argv[arg], "--threads") == 0 && arg + 1 < argc && stringToIntTest(argv[arg + 1]))
+        {
+            threads = std::stoi(argv[++arg]);
+            if (threads < 1 || threads > 256)
+            {
+                fprintf(stderr, "Error: number of threads must be between 1 and 256\n");
+                return 1;
+            }
+        }
+        else if (strcmp(argv[arg], "--batch") == 0)
+        {
+            batch = true;
+            if (arg + 1 < argc && strncmp(argv[arg + 1], "--", 2) != 0)
+            {
+                batch_path = argv[++arg];
+            }
+        }
+        else if (strcmp(argv[arg], "--convert") == 0 && arg + 2 < argc)
+        {
+            // Convert a text command file into a binary trace and exit
+            return convertTrace(argv[arg + 1], argv[arg + 2]);
+        }
+        else if (strcmp(argv[arg], "--replay") == 0 && arg + 1 < argc)
+        {
+            replay_path = argv[++arg];
+        }
+        else
+        {
+            fprintf(stderr, "Error: unknown option '%s'\n", argv[arg]);
+            return 1;
+        }
+    }
+    if (concurrent && paging_options)
+    {
+        fprintf(stderr, "Error: --concurrent has no paging, so --frames, --replace, --swap and --huge-pages can't be used with it\n");
+        return 1;
+    }
+    if (concurrent)
+    {
+        page_table_mode = PageTableMode::Concurrent;
+    }
+    if (threads > 1 && replay_path == NULL)
+    {
+        fprintf(stderr, "Error: --threads needs --replay\n");
+        return 1;
+    }
+    if (!batch && replay_path == NULL)
+    {
+        printStartMessage(page_size);
+    }
 
     // Create physical 'memory'
     uint32_t mem_size = 67108864;
     void *memory = malloc(mem_size); // 64 MB (64 * 1024 * 1024)
 
     // Create MMU and Page Table
-    Mmu *mmu = new Mmu(mem_size);
-    PageTable *page_table = new PageTable(page_size);
+    Mmu *mmu = new Mmu(mem_size, page_size, alloc_policy);
+    mmu->setCompactThreshold(compact_threshold);
+    PageTable *page_table = new PageTable(page_size, page_table_mode, page_table_levels);
+    page_table->enableTlb(tlb_entries, tlb_ways, tlb_policy);
+    if (huge_pages)
+    {
+        page_table->enableHugePages();
+    }
+
+    // Physical memory holds at most mem_size / page_size frames (one of them
+    // the shared zero frame), pages beyond that are swapped out
+    int max_frames = mem_size / page_size;
+    if (frame_limit == 0 || frame_limit > max_frames)
+    {
+        frame_limit = max_frames;
+    }
+    // Shards split the frames, each one also counting the shared zero frame
+    int shard_frame_limit = (frame_limit - 1) / threads + 1;
+    if (shard_frame_limit < 3)
+    {
+        fprintf(stderr, "Error: at least 3 frames are needed\n");
+        return 1;
+    }
+    if (concurrent)
+    {
+        page_table->useMemory(memory, max_frames);
+    }
+    else if (!page_table->enablePaging(memory, frame_limit, replacement_policy, swap_path))
+    {
+        fprintf(stderr, "Error: can't create swap file\n");
+        return 1;
+    }
+
+    // Parallel replay runs processes on one shard (MMU and page table) per thread
+    if (threads > 1)
+    {
+        setvbuf(stdout, NULL, _IOFBF, OUTPUT_BUFFER_SIZE);
+        setvbuf(stderr, NULL, _IOFBF, OUTPUT_BUFFER_SIZE);
+        std::vector<Mmu *> mmus(1, mmu);
+        std::vector<PageTable *> page_tables(1, page_table);
+        if (!concurrent)
+        {
+            page_table->limitFrames(shard_frame_limit);
+        }
+        int i;
+        for (i = 1; i < threads; i++)
+        {
+            mmus.push_back(new Mmu(mem_size, page_size, alloc_policy));
+            mmus[i]->setCompactThreshold(compact_threshold);
+            if (concurrent)
+            {
+                // Every shard translates through the one concurrent page table
+                page_tables.push_back(page_table);
+                continue;
+            }
+            page_tables.push_back(new PageTable(page_size, page_table_mode, page_table_levels));
+            page_tables[i]->enableTlb(tlb_entries, tlb_ways, tlb_policy);
+            if (huge_pages)
+            {
+                page_tables[i]->enableHugePages();
+            }
+            page_tables[i]->shareMemory(page_table);
+        }
+        int status = replayTraceParallel(replay_path, mmus, page_tables, memory);
+        // The first page table owns the memory the others share
+        for (i = threads - 1; i >= 0; i--)
+        {
+            delete mmus[i];
+            if (i == 0 || !concurrent)
+            {
+                delete page_tables[i];
+            }
+        }
+        free(memory);
+        return status;
+    }
+
+    // Replaying a binary trace runs its events instead of the command loop
+    if (replay_path != NULL)
+    {
+        setvbuf(stdout, NULL, _IOFBF, OUTPUT_BUFFER_SIZE);
+        setvbuf(stderr, NULL, _IOFBF, OUTPUT_BUFFER_SIZE);
+        int status = replayTrace(replay_path, mmu, page_table, memory);
+        free(memory);
+        delete mmu;
+        delete page_table;
+        return status;
+    }
+
+    // Batch mode reads commands in large blocks and buffers all output,
+    // interactive mode prompts for one command at a time
+    FILE *batch_file = NULL;
+    if (batch)
+    {
+        batch_file = stdin;
+        if (batch_path != NULL && (batch_file = fopen(batch_path, "r")) == NULL)
+        {
+            fprintf(stderr, "Error: can't open '%s'\n", batch_path);
+            return 1;
+        }
+        setvbuf(stdout, NULL, _IOFBF, OUTPUT_BUFFER_SIZE);
+        setvbuf(stderr, NULL, _IOFBF, OUTPUT_BUFFER_SIZE);
+    }
+    CommandReader reader(batch_file);
+    std::vector<const char *> command_list;
 
     while (1)
     {
         // Prompt input
-        std::string command;
-        std::cout << "> ";
-        std::getline(std::cin, command);
+        if (!batch)
+        {
+            std::cout << "> ";
+        }
+        char *command = reader.nextLine();
+        if (command == NULL)
+        {
+            break;
+        }
         // Handle command
-        // TODO: implement this!
-        std::vector<const char *> command_list;
-        const char *token;
-        token = std::strtok((char *)command.c_str(), " ");
+        splitCommand(command, command_list);
 
         // Check for whitespace
-        if (command == "" || strcmp(token, "") == 0)
+        if (command_list.empty())
         {
             continue;
         }
+        const char *token = command_list[0];
         // exit loop if command is "exit"
-        else if (command == "exit")
+        if (strcmp(token, "exit") == 0)
         {
             break;
         }
         // Check if input is a command, if so, run command
         else if (strcmp(token, "create") == 0)
         {
-            while (token != NULL)
-            {
-                command_list.push_back(token);
-                token = strtok(NULL, " ");
-            }
             if (command_list.size() <= 2 || command_list.size() >= 4)
             {
                 fprintf(stderr, "error: incorrect number of arguments\n");
@@ -83,11 +355,6 @@ int main(int argc, char **argv)
         }
         else if (strcmp(token, "allocate") == 0)
         {
-            while (token != NULL)
-            {
-                command_list.push_back(token);
-                token = strtok(NULL, " ");
-            }
             if (command_list.size() <= 4 || command_list.size() >= 6)
             {
                 fprintf(stderr, "error: incorrect number of arguments\n");
@@ -100,29 +367,12 @@ int main(int argc, char **argv)
             }
             int pid = std::stoi(command_list[1]);
             std::string var_name = command_list[2];
-
-            if (pidExists(pid) == false)
-            {
-                fprintf(stderr, "error: process not found\n");
-                continue;
-            }
-            if (mmu->getVariable(pid, var_name) != NULL)
-            {
-                fprintf(stderr, "error: variable already exists\n");
-                continue;
-            }
-
             DataType type = mmu->stringToDataType(command_list[3]);
             uint32_t num_elements = (uint32_t)std::stoi(command_list[4]);
             allocateVariable(pid, var_name, type, num_elements, mmu, page_table);
         }
         else if (strcmp(token, "set") == 0)
         {
-            while (token != NULL)
-            {
-                command_list.push_back(token);
-                token = strtok(NULL, " ");
-            }
             if (command_list.size() <= 4)
             {
                 fprintf(stderr, "error: not enough arguments\n");
@@ -135,115 +385,48 @@ int main(int argc, char **argv)
             }
             int pid = std::stoi(command_list[1]);
             std::string var_name = command_list[2];
-            if (pidExists(pid) == false)
-            {
-                fprintf(stderr, "error: process not found\n");
-                continue;
-            }
-            if (mmu->getVariable(pid, var_name) == NULL)
-            {
-                fprintf(stderr, "error: variable not found\n");
-                continue;
-            }
-            Variable *var = mmu->getVariable(pid, var_name);
             uint32_t offset = std::stoi(command_list[3]);
-            int num_elements = var->size / mmu->sizeOfType(var->type);
-
-            if (offset > num_elements)
+            setVariable(pid, var_name, offset, command_list, 4, mmu, page_table, memory);
+        }
+        else if (strcmp(token, "fill") == 0 || strcmp(token, "copy") == 0 || strcmp(token, "cmp") == 0)
+        {
+            // "fill <PID> <var_name> <value>", "copy <PID> <source> <destination>"
+            // and "cmp <PID> <var_name> <var_name>"
+            if (command_list.size() < 4)
             {
-                fprintf(stderr, "error: offset exceeds the number of elements for this variable\n");
+                fprintf(stderr, "error: not enough arguments\n");
                 continue;
             }
-            bool bad_input = false;
-            int i;
-            for (i = 4; i < command_list.size(); i++)
-            {
-                if (var->type != DataType::Char && !stringToIntTest(command_list[i]))
-                {
-                    bad_input = true;
-                    break;
-                }
-            }
-            if (bad_input)
+            if (!stringToIntTest(command_list[1]))
             {
-                fprintf(stderr, "error: bad input\n");
+                fprintf(stderr, "error: bad arguments\n");
                 continue;
             }
-            if (var->type == DataType::Char)
-            {
-                for (i = 4; i < command_list.size(); i++)
-                {
-                    char x = *command_list[i];
-                    void *value = (void *)x;
-                    setVariable(pid, var_name, offset, value, mmu, page_table, memory);
-                    offset++;
-                }
-            }
-            else if (var->type == DataType::Short)
+            uint32_t pid = std::stoi(command_list[1]);
+            if (strcmp(token, "fill") == 0)
             {
-                for (i = 4; i < command_list.size(); i++)
-                {
-                    short x = (short)std::stoi(command_list[i]);
-                    void *value = (void *)x;
-                    setVariable(pid, var_name, offset, value, mmu, page_table, memory);
-                    offset++;
-                }
+                fillVariable(pid, command_list[2], command_list[3], mmu, page_table, memory);
             }
-            else if (var->type == DataType::Int)
+            else if (strcmp(token, "copy") == 0)
             {
-                for (i = 4; i < command_list.size(); i++)
-                {
-                    int x = std::stoi(command_list[i]);
-                    void *value = (void *)x;
-                    setVariable(pid, var_name, offset, value, mmu, page_table, memory);
-                    offset++;
-                }
+                copyVariable(pid, command_list[2], command_list[3], mmu, page_table, memory);
             }
-            else if (var->type == DataType::Float)
+            else
             {
-                for (i = 4; i < command_list.size(); i++)
+                uint32_t element;
+                int result = compareVariables(pid, command_list[2], command_list[3], &element, mmu, page_table, memory);
+                if (result == 0)
                 {
-                    float x = std::stof(command_list[i]);
-                    float *p = &x;
-                    void *value = (void *)p;
-                    setVariable(pid, var_name, offset, value, mmu, page_table, memory);
-                    offset++;
+                    printf("equal\n");
                 }
-            }
-            else if (var->type == DataType::Double)
-            {
-                for (i = 4; i < command_list.size(); i++)
+                else if (result > 0)
                 {
-                    double x = std::stod(command_list[i]);
-                    double *p = &x;
-                    void *value = (void *)p;
-                    setVariable(pid, var_name, offset, value, mmu, page_table, memory);
-                    offset++;
+                    printf("differ at element %u\n", element);
                 }
             }
-            else if (var->type == DataType::Long)
-            {
-                for (i = 4; i < command_list.size(); i++)
-                {
-                    long x = std::stol(command_list[i]);
-                    void *value = (void *)x;
-                    setVariable(pid, var_name, offset, value, mmu, page_table, memory);
-                    offset++;
-                }
-            }
-            else 
-            {
-                fprintf(stderr, "error: wrong data type\n");
-                continue;
-            }
         }
         else if (strcmp(token, "print") == 0)
         {
-            while (token != NULL)
-            {
-                command_list.push_back(token);
-                token = strtok(NULL, " ");
-            }
             if (command_list.size() <= 1)
             {
                 // print error
@@ -259,15 +442,22 @@ int main(int argc, char **argv)
             {
                 page_table->print();
             }
+            else if (print_str.compare("free") == 0)
+            {
+                mmu->printFreeSpace();
+            }
+            else if (print_str.compare("pagestats") == 0)
+            {
+                page_table->printStats();
+            }
             else if (print_str.compare("processes") == 0)
             {
-                // if pids are not empty, then print the pids
-                if (!pids.empty())
+                // print the pids of the live processes, oldest first
+                std::vector<uint32_t> pids;
+                mmu->processIds(pids);
+                for (int k = 0; k < pids.size(); k++)
                 {
-                    for (int k = 0; k < pids.size(); k++)
-                    {
-                        std::cout << pids[k] << std::endl;
-                    }
+                    std::cout << pids[k] << "\n";
                 }
             }
             else
@@ -282,145 +472,62 @@ int main(int argc, char **argv)
                 }
                 uint32_t pid = std::stoi(pid_string);
                 std::string var_name = print_str.substr(sep + 1);
-                Variable *var = mmu->getVariable(pid, var_name);
-                if (pidExists(pid) == false)
+                printVariable(pid, var_name, mmu, page_table, memory);
+            }
+        }
+        else if (strcmp(token, "stats") == 0)
+        {
+            // "stats [text|json|csv] [file]"
+            StatsFormat format = StatsFormat::StatsText;
+            if (command_list.size() > 1)
+            {
+                if (strcmp(command_list[1], "json") == 0)
                 {
-                    fprintf(stderr, "error: process not found\n");
-                    continue;
+                    format = StatsFormat::StatsJson;
                 }
-                else if (var == NULL)
+                else if (strcmp(command_list[1], "csv") == 0)
                 {
-                    fprintf(stderr, "error: variable not found\n");
-                    continue;
+                    format = StatsFormat::StatsCsv;
                 }
-                // Now print PID:var_name
-                int physical_address = 0;
-                int type_size = mmu->sizeOfType(var->type);
-                int num_elements = var->size / type_size;
-                int offset = 0;
-                if (var->type == DataType::FreeSpace)
+                else if (strcmp(command_list[1], "text") != 0)
                 {
-                    fprintf(stderr, "error: can't print Free Space\n");
+                    fprintf(stderr, "error: stats format must be text, json or csv\n");
                     continue;
                 }
-                // Print elements of variable
-                int i;
-                if (var->type == DataType::Char)
-                {
-                    for (i = 0; i < num_elements; i++)
-                    {   
-                        offset = i * type_size;
-                        physical_address = page_table->getPhysicalAddress(pid, var->virtual_address + offset);
-                        char x;
-                        memcpy(&x, (uint8_t *)memory + physical_address, type_size);
-                        if (i != (num_elements - 1))
-                            std::cout << x << ", ";
-                        else
-                            std::cout << x << std::endl;
-                        if (i == 3)
-                            break;
-                    }
-                }
-                else if (var->type == DataType::Short)
-                {
-                    for (i = 0; i < num_elements; i++)
-                    {   
-                        offset = i * type_size;
-                        physical_address = page_table->getPhysicalAddress(pid, var->virtual_address + offset);
-                        short x;
-                        memcpy(&x, (uint8_t *)memory + physical_address, type_size);
-                        if (i != (num_elements - 1))
-                            std::cout << x << ", ";
-                        else
-                            std::cout << x << std::endl;
-                        if (i == 3)
-                            break;
-                    }
-                }
-                else if (var->type == DataType::Int)
-                {
-                    for (i = 0; i < num_elements; i++)
-                    {
-                        offset = i * type_size;
-                        physical_address = page_table->getPhysicalAddress(pid, var->virtual_address + offset);
-                        int x;
-                        memcpy(&x, (uint8_t *)memory + physical_address, type_size);
-                        if (i != (num_elements - 1))
-                            std::cout << x << ", ";
-                        else
-                            std::cout << x << std::endl;
-                        if (i == 3)
-                            break;
-                    }
-                }
-                else if (var->type == DataType::Float)
-                {
-                    for (i = 0; i < num_elements; i++)
-                    {
-                        offset = i * type_size;
-                        physical_address = page_table->getPhysicalAddress(pid, var->virtual_address + offset);
-                        float x;
-                        memcpy(&x, (uint8_t *)memory + physical_address, type_size);
-                        if (i != (num_elements - 1))
-                            std::cout << x << ", ";
-                        else
-                            std::cout << x << std::endl;
-                        if (i == 3)
-                            break;
-                    }
-                }
-                else if (var->type == DataType::Double)
-                {
-                    for (i = 0; i < num_elements; i++)
-                    {
-                        offset = i * type_size;
-                        physical_address = page_table->getPhysicalAddress(pid, var->virtual_address + offset);
-                        double x;
-                        memcpy(&x, (uint8_t *)memory + physical_address, type_size);
-                        if (i != (num_elements - 1))
-                            std::cout << x << ", ";
-                        else
-                            std::cout << x << std::endl;
-                        if (i == 3)
-                            break;
-                    }
-                }
-                else if (var->type == DataType::Long)
-                {
-                    for (i = 0; i < num_elements; i++)
-                    {
-                        offset = i * type_size;
-                        physical_address = page_table->getPhysicalAddress(pid, var->virtual_address + offset);
-                        long x;
-                        memcpy(&x, (uint8_t *)memory + physical_address, type_size);
-                        if (i != (num_elements - 1))
-                            std::cout << x << ", ";
-                        else
-                            std::cout << x << std::endl;
-                        if (i == 3)
-                            break;
-                    }
-                }
-                else
-                {
-                    fprintf(stderr, "error: wrong data type");
+            }
+            FILE *out = stdout;
+            if (command_list.size() > 2 && (out = fopen(command_list[2], "w")) == NULL)
+            {
+                fprintf(stderr, "error: can't create '%s'\n", command_list[2]);
+                continue;
+            }
+            writeStats(mmu, page_table, format, out);
+            if (out != stdout)
+            {
+                fclose(out);
+            }
+        }
+        else if (strcmp(token, "fragmentation") == 0)
+        {
+            // "fragmentation [PID]"
+            int pid = -1;
+            if (command_list.size() > 1)
+            {
+                if (!stringToIntTest(command_list[1]))
+                { // bad pid
                     continue;
                 }
-                // If variable has more than 4 elements, just print the first 4 followed by "... [N items]"
-                // (where N is the number of elements)
-                if (num_elements > 4)
+                pid = std::stoi(command_list[1]);
+                if (pidExists(pid, mmu) == false)
                 {
-                    printf("... [%d items]\n", num_elements);
+                    fprintf(stderr, "error: process not found\n");
+                    continue;
                 }
             }
+            mmu->printFragmentation(pid);
         }
         else if (strcmp(token, "free") == 0)
         {
-            while (token != NULL)
-            {
-                command_list.push_back(token);
-                token = strtok(NULL, " ");
-            }
             if (command_list.size() <= 2)
             { // not enough arguments
                 continue;
@@ -432,14 +539,10 @@ int main(int argc, char **argv)
             uint32_t pid = std::stoi(command_list[1]);
             std::string var_name = command_list[2];
             freeVariable(pid, var_name, mmu, page_table);
+            compactIfFragmented(pid, mmu, page_table, memory);
         }
-        else if (strcmp(token, "terminate") == 0)
+        else if (strcmp(token, "compact") == 0)
         {
-            while (token != NULL)
-            {
-                command_list.push_back(token);
-                token = strtok(NULL, " ");
-            }
             if (command_list.size() < 2)
             { // not enough arguments
                 continue;
@@ -449,234 +552,103 @@ int main(int argc, char **argv)
                 continue;
             }
             uint32_t pid = std::stoi(command_list[1]);
-            terminateProcess(pid, mmu, page_table);
+            compactProcess(pid, mmu, page_table, memory);
         }
-        else
+        else if (strcmp(token, "save") == 0)
         {
-            printf("error: command not recognized\n");
-        }
-    }
-
-    // Clean up
-    free(memory);
-    delete mmu;
-    delete page_table;
-
-    return 0;
-}
-
-void printStartMessage(int page_size)
-{
-    std::cout << "Welcome to the Memory Allocation Simulator! Using a page size of " << page_size << " bytes." << std::endl;
-    std::cout << "Commands:" << std::endl;
-    std::cout << "  * create <text_size> <data_size> (initializes a new process)" << std::endl;
-    std::cout << "  * allocate <PID> <var_name> <data_type> <number_of_elements> (allocated memory on the heap)" << std::endl;
-    std::cout << "  * set <PID> <var_name> <offset> <value_0> <value_1> <value_2> ... <value_N> (set the value for a variable)" << std::endl;
-    std::cout << "  * free <PID> <var_name> (deallocate memory on the heap that is associated with <var_name>)" << std::endl;
-    std::cout << "  * terminate <PID> (kill the specified process)" << std::endl;
-    std::cout << "  * print <object> (prints data)" << std::endl;
-    std::cout << "    * If <object> is \"mmu\", print the MMU memory table" << std::endl;
-    std::cout << "    * if <object> is \"page\", print the page table" << std::endl;
-    std::cout << "    * if <object> is \"processes\", print a list of PIDs for processes that are still running" << std::endl;
-    std::cout << "    * if <object> is a \"<PID>:<var_name>\", print the value of the variable for that process" << std::endl;
-    std::cout << std::endl;
-}
-
-void createProcess(int text_size, int data_size, Mmu *mmu, PageTable *page_table)
-{
-    // TODO: implement this!
-    //   - create new process in the MMU
-    uint32_t pid = mmu->createProcess();
-    pids.push_back(pid);
-    //   - allocate new variables for the <TEXT>, <GLOBALS>, and <STACK>
-    //   - DataType is Char because `n` Chars is `n` bytes
-    allocateVariable(pid, "<TEXT>"   , DataType::Char, text_size, mmu, page_table);
-    allocateVariable(pid, "<GLOBALS>", DataType::Char, data_size, mmu, page_table);
-    allocateVariable(pid, "<STACK>"  , DataType::Char, 65536    , mmu, page_table);
-    //   - print pid
-    printf("%d\n", pid);
-}
-
-void allocateVariable(uint32_t pid, std::string var_name, DataType type, uint32_t num_elements, Mmu *mmu, PageTable *page_table)
-{
-    // TODO: implement this!
-    uint32_t size_bytes = (uint32_t)mmu->sizeOfType(type) * num_elements;
-    int page_size = page_table->_page_size;
-    //   - find first <free space> in virtual memory (mmu) of size within a page already allocated to this process that is large enough to fit the new variable
-    Variable *var = mmu->findFreeSpace(pid, size_bytes);
-    if (var != NULL)
-    {
-        //   - insert variable into MMU
-        mmu->addVariableToProcess(pid, var_name, type, size_bytes, var->virtual_address);
-
-        // find page number for virtual address and virtual address + size
-        int n = (int)log2(page_size); // n = number of bits for page offset
-        int page_number = var->virtual_address >> n;
-        int next_page_number = var->virtual_address + size_bytes - 1 >> n;
-
-        if (next_page_number > 500)
-        {
-            printf("That's a lot of memory, please wait...\n");
-        }
-        // If the page number for the current virtual address is not equal to page number of the next
-        // virtual address, this means the size is too big for the current page, allocate new page.
-        while (page_number <= next_page_number)
-        {   
-            // If frame is not already in the page_table, add an entry for that page
-            if (page_table->getFrame(pid, page_number) == -1)
-            {
-                page_table->addEntry(pid, page_number);
+            if (command_list.size() < 2)
+            { // not enough arguments
+                continue;
             }
-            page_number++;
-        }
-        //   - print virtual memory address
-        if (var_name.compare("<TEXT>") != 0 && var_name.compare("<GLOBALS>") != 0 && var_name.compare("<STACK>") != 0)
-        {
-            std::cout << var->virtual_address << std::endl;
-        }
-        var->virtual_address += size_bytes;
-    }
-    else
-    {
-        if (pidExists(pid) == false)
-        {
-            fprintf(stderr, "error: process not found\n");
+            saveImage(command_list[1], mmu, page_table, mem_size);
         }
-        else if (type == DataType::Err)
+        else if (strcmp(token, "load") == 0)
         {
-            fprintf(stderr, "error: bad data type\n");
+            if (command_list.size() < 2)
+            { // not enough arguments
+                continue;
+            }
+            // "load <file> [<checkpoint> ...]"
+            std::vector<const char *> paths(command_list.begin() + 1, command_list.end());
+            loadImage(paths, mmu, page_table, mem_size);
         }
-        else
+        else if (strcmp(token, "checkpoint") == 0)
         {
-            fprintf(stderr, "error: not enough memory\n");
-        }
-    }
-}
-
-void setVariable(uint32_t pid, std::string var_name, uint32_t offset, void *value, Mmu *mmu, PageTable *page_table, void *memory)
-{
-    // TODO: implement this!
-    Variable *var = mmu->getVariable(pid, var_name);
-    offset = offset * mmu->sizeOfType(var->type);
-
-    if (var != NULL)
-    {
-        uint32_t type_size = mmu->sizeOfType(var->type);
-        //   - look up physical address for variable based on its virtual address / offset
-        int physical_address = page_table->getPhysicalAddress(pid, (var->virtual_address + offset));
-        //   - insert `value` into `memory` at physical address
-        if (var->type == DataType::Double || var->type == DataType::Float)
-        {
-            memcpy((uint8_t *)memory + physical_address, value, type_size);
+            if (command_list.size() < 2)
+            { // not enough arguments
+                continue;
+            }
+            saveCheckpoint(command_list[1], mmu, page_table, mem_size);
         }
-        else
+        else if (strcmp(token, "fork") == 0)
         {
-            memcpy((uint8_t *)memory + physical_address, &value, type_size);
+            if (command_list.size() < 2)
+            { // not enough arguments
+                continue;
+            }
+            if (!stringToIntTest(command_list[1]))
+            { // bad pid
+                continue;
+            }
+            uint32_t pid = std::stoi(command_list[1]);
+            forkProcess(pid, mmu, page_table);
         }
-    }
-    else
-    {
-        if (pidExists(pid) == false)
+        else if (strcmp(token, "terminate") == 0)
         {
-            // Error, process not found
-            fprintf(stderr, "error: process not found\n");
+            if (command_list.size() < 2)
+            { // not enough arguments
+                continue;
+            }
+            if (!stringToIntTest(command_list[1]))
+            { // bad pid
+                continue;
+            }
+            uint32_t pid = std::stoi(command_list[1]);
+            terminateProcess(pid, mmu, page_table);
         }
         else
         {
-            // Error, variable not found
-            fprintf(stderr, "error: variable not found\n");
+            printf("error: command not recognized\n");
         }
     }
-    //   * note: this function only handles a single element (i.e. you'll need to call this within a loop when setting
-    //           multiple elements of an array)
-}
-
-void freeVariable(uint32_t pid, std::string var_name, Mmu *mmu, PageTable *page_table)
-{
-    // TODO: implement this!
-    int page_size = page_table->_page_size;
-    int page_number = 0;
-    int next_page_number = 0;
-    
-    int n = (int)log2(page_size); // n = number of bits for page offset
-    Variable *var = mmu->getVariable(pid, var_name);
 
-    if (var != NULL)
-    {
-        page_number = var->virtual_address >> n;
-        next_page_number = var->virtual_address + var->size - 1 >> n;
-        //   - free page if this variable was the only one on a given page
-        while (page_number <= next_page_number)
-        {
-            if (mmu->isVariableInOwnPage(pid, var, page_number, page_table))
-            {
-                page_table->freeFrame(pid, page_number);
-            }
-            page_number++;
-        }
-
-        //   - remove entry from MMU
-        var->type = DataType::FreeSpace;
-        var->name = "<FREE_SPACE>";
-
-        mmu->mergeFreeSpace(pid, var);
-    }
-    else
+    // Clean up
+    if (batch_file != NULL && batch_file != stdin)
     {
-        if (pidExists(pid) == false)
-        {
-            fprintf(stderr, "error: process not found\n");
-        }
-        else
-        {
-            fprintf(stderr, "error: variable not found\n");
-        }
+        fclose(batch_file);
     }
-}
+    free(memory);
+    delete mmu;
+    delete page_table;
 
-void terminateProcess(uint32_t pid, Mmu *mmu, PageTable *page_table)
-{
-    //   - remove process from MMU
-    mmu->deleteProcess(pid);
-    //   - free all pages associated with given process
-    page_table->freeProcessPages(pid);
-    //   - remove pid from list of pids
-    std::vector<int>::iterator it = pids.begin() + (pid-1024);
-    pids.erase(it);
+    return 0;
 }
 
-// Returns: true if input can be converted to an integer, false otherwise
-bool stringToIntTest(std::string input)
+void printStartMessage(int page_size)
 {
-    bool is_integer = true;
-    // go through each character of input, checking for data type errors
-    for (int i = 0; i < input.length(); i++)
-    {
-        // try input to integer conversion
-        try
-        {
-            std::stoi(input.substr(i, i + 1));
-        }
-        // if conversion fails, input must be wrong data type
-        catch (const std::invalid_argument e)
-        {
-            is_integer = false;
-            break;
-        }
-    }
-    return is_integer;
+    std::cout << "Welcome to the Memory Allocation Simulator! Using a page size of " << page_size << " bytes." << std::endl;
+    std::cout << "Commands:" << "\n";
+    std::cout << "  * create <text_size> <data_size> (initializes a new process)" << "\n";
+    std::cout << "  * allocate <PID> <var_name> <data_type> <number_of_elements> (allocated memory on the heap)" << "\n";
+    std::cout << "  * set <PID> <var_name> <offset> <value_0> <value_1> <value_2> ... <value_N> (set the value for a variable)" << "\n";
+    std::cout << "  * fill <PID> <var_name> <value> (set every element of a variable to <value>)" << "\n";
+    std::cout << "  * copy <PID> <source> <destination> (copy the elements of a variable into another of the same type)" << "\n";
+    std::cout << "  * cmp <PID> <var_name> <var_name> (compare two variables of the same type, print the first element that differs)" << "\n";
+    std::cout << "  * free <PID> <var_name> (deallocate memory on the heap that is associated with <var_name>)" << "\n";
+    std::cout << "  * fork <PID> (copy a process, sharing its pages copy-on-write)" << "\n";
+    std::cout << "  * terminate <PID> (kill the specified process)" << "\n";
+    std::cout << "  * compact <PID> (move the variables of a process to the start of its memory and release emptied pages, unless that takes more frames than it frees)" << "\n";
+    std::cout << "  * save <file> (write every process, its variables and the frames in use to an image file)" << "\n";
+    std::cout << "  * checkpoint <file> (like save, but only write the frames changed since the last save, checkpoint or load)" << "\n";
+    std::cout << "  * load <file> [<checkpoint> ...] (terminate every process and restore the ones saved in an image file and its checkpoints)" << "\n";
+    std::cout << "  * stats [text|json|csv] [file] (allocation, paging and latency counters, per process and in total)" << "\n";
+    std::cout << "  * fragmentation [PID] (free block sizes, page fill and fragmentation of every process or of one)" << "\n";
+    std::cout << "  * print <object> (prints data)" << "\n";
+    std::cout << "    * If <object> is \"mmu\", print the MMU memory table" << "\n";
+    std::cout << "    * if <object> is \"page\", print the page table" << "\n";
+    std::cout << "    * if <object> is \"free\", print free space and fragmentation metrics for each process" << "\n";
+    std::cout << "    * if <object> is \"pagestats\", print page table memory footprint, translation walk and TLB counts" << "\n";
+    std::cout << "    * if <object> is \"processes\", print a list of PIDs for processes that are still running" << "\n";
+    std::cout << "    * if <object> is a \"<PID>:<var_name>\", print the value of the variable for that process" << "\n";
+    std::cout << "\n";
 }
-
-// Returns: true if pid exists, false if pid does not exist
-bool pidExists(int pid)
-{
-    int i;
-    for (i = 0; i < pids.size(); i++)
-    {
-        if (pid == pids[i])
-        {
-            return true;
-        }
-    }
-    return false;
-}
\ No newline at end of file
@@ -0,0 +1,45 @@
+#include "memops.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+void fillPattern(uint8_t *destination, size_t size, const uint8_t *pattern)
+{
+    size_t i = 0;
+#ifdef __SSE2__
+    __m128i value = _mm_loadu_si128((const __m128i *)pattern);
+    for (; i + MEMOPS_WIDTH <= size; i += MEMOPS_WIDTH)
+    {
+        _mm_storeu_si128((__m128i *)(destination + i), value);
+    }
+#endif
+    for (; i < size; i++)
+    {
+        destination[i] = pattern[i % MEMOPS_WIDTH];
+    }
+}
+
+size_t firstDifference(const uint8_t *a, const uint8_t *b, size_t size)
+{
+    size_t i = 0;
+#ifdef __SSE2__
+    for (; i + MEMOPS_WIDTH <= size; i += MEMOPS_WIDTH)
+    {
+        __m128i equal = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(a + i)),
+                                       _mm_loadu_si128((const __m128i *)(b + i)));
+        unsigned int mask = _mm_movemask_epi8(equal);
+        if (mask != 0xffff)
+        {
+            return i + __builtin_ctz(~mask);
+        }
+    }
+#endif
+    for (; i < size; i++)
+    {
+        if (a[i] != b[i])
+        {
+            return i;
+        }
+    }
+    return size;
+}
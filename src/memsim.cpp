@@ -0,0 +1,781 @@
+#include "memsim.h"
+#include "memops.h"
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+#include <unordered_set>
+
+void createProcess(int text_size, int data_size, Mmu *mmu, PageTable *page_table)
+{
+    OpTimer timer(mmu, SimOp::OpCreate);
+    //   - create new process in the MMU
+    uint32_t pid = mmu->createProcess();
+    //   - allocate new variables for the <TEXT>, <GLOBALS>, and <STACK>
+    //   - DataType is Char because `n` Chars is `n` bytes
+    allocateVariable(pid, "<TEXT>"   , DataType::Char, text_size, mmu, page_table);
+    allocateVariable(pid, "<GLOBALS>", DataType::Char, data_size, mmu, page_table);
+    allocateVariable(pid, "<STACK>"  , DataType::Char, 65536    , mmu, page_table);
+    //   - print pid
+    printf("%d\n", pid);
+}
+
+void allocateVariable(uint32_t pid, std::string var_name, DataType type, uint32_t num_elements, Mmu *mmu, PageTable *page_table)
+{
+    OpTimer timer(mmu, SimOp::OpAllocate);
+    if (pidExists(pid, mmu) == false)
+    {
+        fprintf(stderr, "error: process not found\n");
+        return;
+    }
+    if (mmu->getVariable(pid, var_name) != NULL)
+    {
+        fprintf(stderr, "error: variable already exists\n");
+        return;
+    }
+
+    uint32_t size_bytes = (uint32_t)mmu->sizeOfType(type) * num_elements;
+    int page_size = page_table->_page_size;
+    //   - find <free space> in virtual memory (mmu) large enough to fit the new variable, using the mmu's allocation policy
+    int address = -1;
+    if (type != DataType::Err)
+    {
+        address = mmu->findFreeSpace(pid, size_bytes);
+    }
+    if (address >= 0)
+    {
+        //   - insert variable into MMU
+        mmu->addVariableToProcess(pid, var_name, type, size_bytes, address);
+
+        // find page number for virtual address and virtual address + size
+        int n = (int)log2(page_size); // n = number of bits for page offset
+        int page_number = address >> n;
+        int next_page_number = (int)(address + size_bytes - 1) >> n;
+
+        if (next_page_number > 500)
+        {
+            printf("That's a lot of memory, please wait...\n");
+        }
+        // Map every page the variable touches that isn't mapped yet (large
+        // variables may get large or huge pages)
+        if (size_bytes > 0)
+        {
+            page_table->addRange(pid, page_number, next_page_number);
+        }
+        //   - print virtual memory address
+        if (var_name.compare("<TEXT>") != 0 && var_name.compare("<GLOBALS>") != 0 && var_name.compare("<STACK>") != 0)
+        {
+            std::cout << address << "\n";
+        }
+    }
+    else
+    {
+        if (pidExists(pid, mmu) == false)
+        {
+            fprintf(stderr, "error: process not found\n");
+        }
+        else if (type == DataType::Err)
+        {
+            fprintf(stderr, "error: bad data type\n");
+        }
+        else
+        {
+            mmu->recordFailedAllocation(pid);
+            fprintf(stderr, "error: not enough memory\n");
+        }
+    }
+}
+
+void freeVariable(uint32_t pid, std::string var_name, Mmu *mmu, PageTable *page_table)
+{
+    OpTimer timer(mmu, SimOp::OpFree);
+    int page_size = page_table->_page_size;
+    int page_number = 0;
+    int next_page_number = 0;
+    
+    int n = (int)log2(page_size); // n = number of bits for page offset
+    Variable *var = mmu->getVariable(pid, var_name);
+
+    if (var != NULL)
+    {
+        page_number = var->virtual_address >> n;
+        next_page_number = var->virtual_address + var->size - 1 >> n;
+        uint32_t size = var->size;
+
+        //   - remove entry from MMU and return its space to the process's free space,
+        //     which also takes its bytes off the live bytes of every page it spans
+        mmu->mergeFreeSpace(pid, var);
+
+        //   - free every page no other variable is on
+        while (size > 0 && page_number <= next_page_number)
+        {
+            if (mmu->pageBytes(pid, page_number) == 0)
+            {
+                page_table->freeFrame(pid, page_number);
+            }
+            page_number++;
+        }
+    }
+    else
+    {
+        if (pidExists(pid, mmu) == false)
+        {
+            fprintf(stderr, "error: process not found\n");
+        }
+        else
+        {
+            fprintf(stderr, "error: variable not found\n");
+        }
+    }
+}
+
+void forkProcess(uint32_t pid, Mmu *mmu, PageTable *page_table)
+{
+    OpTimer timer(mmu, SimOp::OpFork);
+    if (pidExists(pid, mmu) == false)
+    {
+        fprintf(stderr, "error: process not found\n");
+        return;
+    }
+    int child = mmu->forkProcess(pid);
+    //   - share every page of the parent with the child, copy-on-write
+    //     (or copy them up front without paging)
+    if (!page_table->forkPages(pid, child))
+    {
+        mmu->deleteProcess(child);
+        fprintf(stderr, "error: out of memory\n");
+        return;
+    }
+    printf("%d\n", child);
+}
+
+void terminateProcess(uint32_t pid, Mmu *mmu, PageTable *page_table)
+{
+    OpTimer timer(mmu, SimOp::OpTerminate);
+    //   - remove process from MMU
+    mmu->deleteProcess(pid);
+    //   - free all pages associated with given process
+    page_table->freeProcessPages(pid);
+}
+
+// Returns: true if input can be converted to an integer, false otherwise
+bool stringToIntTest(const std::string &input)
+{
+    // every character must be a digit
+    int i;
+    for (i = 0; i < input.length(); i++)
+    {
+        if (input[i] < '0' || input[i] > '9')
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Returns: true if pid exists, false if pid does not exist
+bool pidExists(int pid, Mmu *mmu)
+{
+    return mmu->hasProcess(pid);
+}
+
+// Returns the variable targeted by a `set` command, or NULL (after printing
+// the error) if the process or variable don't exist or `offset` is out of range
+Variable* findSetTarget(uint32_t pid, std::string var_name, uint32_t offset, Mmu *mmu)
+{
+    if (pidExists(pid, mmu) == false)
+    {
+        fprintf(stderr, "error: process not found\n");
+        return NULL;
+    }
+    Variable *var = mmu->getVariable(pid, var_name);
+    if (var == NULL)
+    {
+        fprintf(stderr, "error: variable not found\n");
+        return NULL;
+    }
+    int num_elements = var->size / mmu->sizeOfType(var->type);
+    if (offset > num_elements)
+    {
+        fprintf(stderr, "error: offset exceeds the number of elements for this variable\n");
+        return NULL;
+    }
+    return var;
+}
+
+// Walk the byte range [offset, offset + size) of a variable one page-contiguous
+// run at a time, copying to memory when `write` is set and from it otherwise.
+// Returns the number of pages translated, or -1 if one isn't mapped
+static int copyElements(uint32_t pid, Variable *var, uint32_t offset, uint8_t *buffer, uint32_t size, bool write,
+                         PageTable *page_table, void *memory)
+{
+    uint32_t page_size = page_table->_page_size;
+    uint32_t virtual_address = var->virtual_address + offset;
+    int translations = 0;
+    while (size > 0)
+    {
+        uint32_t run = page_size - (virtual_address & (page_size - 1));
+        if (run > size)
+        {
+            run = size;
+        }
+        int physical_address = page_table->getPhysicalAddress(pid, virtual_address, write);
+        translations++;
+        if (physical_address < 0)
+        {
+            return -1;
+        }
+        if (write)
+        {
+            memcpy((uint8_t *)memory + physical_address, buffer, run);
+        }
+        else
+        {
+            memcpy(buffer, (uint8_t *)memory + physical_address, run);
+        }
+        virtual_address += run;
+        buffer += run;
+        size -= run;
+    }
+    return translations;
+}
+
+// Returns a variable of a process, or NULL after printing the error
+static Variable* lookupVariable(uint32_t pid, const std::string &var_name, Mmu *mmu)
+{
+    Variable *var = mmu->getVariable(pid, var_name);
+    if (var == NULL)
+    {
+        if (pidExists(pid, mmu) == false)
+        {
+            fprintf(stderr, "error: process not found\n");
+        }
+        else
+        {
+            fprintf(stderr, "error: variable not found\n");
+        }
+    }
+    return var;
+}
+
+// Checks shared by writeElements and readElements, returns the variable or
+// NULL after printing the error
+static Variable* findElements(uint32_t pid, std::string var_name, DataType type, uint32_t offset, uint32_t count, Mmu *mmu)
+{
+    Variable *var = lookupVariable(pid, var_name, mmu);
+    if (var == NULL)
+    {
+        return NULL;
+    }
+    if (var->type != type)
+    {
+        fprintf(stderr, "error: wrong data type\n");
+        return NULL;
+    }
+    uint32_t num_elements = var->size / mmu->sizeOfType(type);
+    if (offset > num_elements || count > num_elements - offset)
+    {
+        fprintf(stderr, "error: offset exceeds the number of elements for this variable\n");
+        return NULL;
+    }
+    return var;
+}
+
+int writeElements(uint32_t pid, std::string var_name, DataType type, uint32_t offset, const void *values, uint32_t count,
+                  Mmu *mmu, PageTable *page_table, void *memory)
+{
+    OpTimer timer(mmu, SimOp::OpSet);
+    Variable *var = findElements(pid, var_name, type, offset, count, mmu);
+    if (var == NULL)
+    {
+        return -1;
+    }
+    uint32_t type_size = mmu->sizeOfType(type);
+    int translations = copyElements(pid, var, offset * type_size, (uint8_t *)values, count * type_size, true, page_table, memory);
+    if (translations < 0)
+    {
+        fprintf(stderr, "error: page not mapped\n");
+        return -1;
+    }
+    mmu->recordTranslations(pid, translations);
+    return count;
+}
+
+int readElements(uint32_t pid, std::string var_name, DataType type, uint32_t offset, void *values, uint32_t count,
+                 Mmu *mmu, PageTable *page_table, void *memory)
+{
+    Variable *var = findElements(pid, var_name, type, offset, count, mmu);
+    if (var == NULL)
+    {
+        return -1;
+    }
+    uint32_t type_size = mmu->sizeOfType(type);
+    int translations = copyElements(pid, var, offset * type_size, (uint8_t *)values, count * type_size, false, page_table, memory);
+    if (translations < 0)
+    {
+        fprintf(stderr, "error: page not mapped\n");
+        return -1;
+    }
+    mmu->recordTranslations(pid, translations);
+    return count;
+}
+
+// One element repeated over MEMOPS_WIDTH bytes, the pattern fillPattern() writes
+struct PatternKernel {
+    template <typename T>
+    static void run(const char *token, uint8_t *pattern, bool *ok)
+    {
+        static_assert(MEMOPS_WIDTH % sizeof(T) == 0, "elements must tile the fill pattern");
+        T value;
+        *ok = parseElement(token, &value);
+        int i;
+        for (i = 0; i < MEMOPS_WIDTH; i += sizeof(T))
+        {
+            memcpy(pattern + i, &value, sizeof(T));
+        }
+    }
+};
+
+int fillVariable(uint32_t pid, std::string var_name, const char *value, Mmu *mmu, PageTable *page_table, void *memory)
+{
+    OpTimer timer(mmu, SimOp::OpFill);
+    Variable *var = lookupVariable(pid, var_name, mmu);
+    if (var == NULL)
+    {
+        return -1;
+    }
+    uint8_t pattern[MEMOPS_WIDTH];
+    bool ok = false;
+    if (!dispatchElementType<PatternKernel>(var->type, value, pattern, &ok))
+    {
+        fprintf(stderr, "error: wrong data type\n");
+        return -1;
+    }
+    if (!ok)
+    {
+        fprintf(stderr, "error: bad input\n");
+        return -1;
+    }
+    uint32_t page_size = page_table->_page_size;
+    uint32_t offset = 0;
+    int translations = 0;
+    while (offset < var->size)
+    {
+        uint32_t virtual_address = var->virtual_address + offset;
+        uint32_t run = page_size - (virtual_address & (page_size - 1));
+        if (run > var->size - offset)
+        {
+            run = var->size - offset;
+        }
+        int physical_address = page_table->getPhysicalAddress(pid, virtual_address, true);
+        translations++;
+        if (physical_address < 0)
+        {
+            fprintf(stderr, "error: page not mapped\n");
+            return -1;
+        }
+        // The run starts `offset` bytes into the variable, part way into an element
+        uint8_t rotated[MEMOPS_WIDTH];
+        int i;
+        for (i = 0; i < MEMOPS_WIDTH; i++)
+        {
+            rotated[i] = pattern[(offset + i) % MEMOPS_WIDTH];
+        }
+        fillPattern((uint8_t *)memory + physical_address, run, rotated);
+        offset += run;
+    }
+    mmu->recordTranslations(pid, translations);
+    return var->size / mmu->sizeOfType(var->type);
+}
+
+// Both variables of a copy or cmp, or false after printing the error
+static bool lookupPair(uint32_t pid, const std::string &first_name, const std::string &second_name, Mmu *mmu,
+                       Variable **first, Variable **second)
+{
+    *first = lookupVariable(pid, first_name, mmu);
+    *second = *first != NULL ? lookupVariable(pid, second_name, mmu) : NULL;
+    if (*second == NULL)
+    {
+        return false;
+    }
+    if ((*first)->type != (*second)->type || (*first)->type == DataType::FreeSpace)
+    {
+        fprintf(stderr, "error: wrong data type\n");
+        return false;
+    }
+    return true;
+}
+
+int copyVariable(uint32_t pid, std::string source_name, std::string destination_name, Mmu *mmu, PageTable *page_table,
+                 void *memory)
+{
+    OpTimer timer(mmu, SimOp::OpCopy);
+    Variable *source;
+    Variable *destination;
+    if (!lookupPair(pid, source_name, destination_name, mmu, &source, &destination))
+    {
+        return -1;
+    }
+    // A page at a time through a buffer, since translating one variable may
+    // evict the frame just translated for the other
+    uint32_t page_size = page_table->_page_size;
+    uint32_t size = std::min(source->size, destination->size);
+    std::vector<uint8_t> buffer(page_size);
+    uint32_t offset;
+    int translations = 0;
+    for (offset = 0; offset < size; offset += page_size)
+    {
+        uint32_t chunk = std::min(page_size, size - offset);
+        int read = copyElements(pid, source, offset, buffer.data(), chunk, false, page_table, memory);
+        int written = read >= 0 ? copyElements(pid, destination, offset, buffer.data(), chunk, true, page_table, memory) : -1;
+        if (written < 0)
+        {
+            fprintf(stderr, "error: page not mapped\n");
+            return -1;
+        }
+        translations += read + written;
+    }
+    mmu->recordTranslations(pid, translations);
+    return size / mmu->sizeOfType(source->type);
+}
+
+int compareVariables(uint32_t pid, std::string first_name, std::string second_name, uint32_t *element, Mmu *mmu,
+                     PageTable *page_table, void *memory)
+{
+    OpTimer timer(mmu, SimOp::OpCompare);
+    Variable *first;
+    Variable *second;
+    if (!lookupPair(pid, first_name, second_name, mmu, &first, &second))
+    {
+        return -1;
+    }
+    // A page of the first variable is read into a buffer, and compared with
+    // the second one in place, one page-contiguous run at a time
+    uint32_t page_size = page_table->_page_size;
+    uint32_t type_size = mmu->sizeOfType(first->type);
+    uint32_t size = std::min(first->size, second->size);
+    std::vector<uint8_t> buffer(page_size);
+    uint32_t offset;
+    int translations = 0;
+    for (offset = 0; offset < size; offset += page_size)
+    {
+        uint32_t chunk = std::min(page_size, size - offset);
+        int read = copyElements(pid, first, offset, buffer.data(), chunk, false, page_table, memory);
+        if (read < 0)
+        {
+            fprintf(stderr, "error: page not mapped\n");
+            return -1;
+        }
+        translations += read;
+        uint32_t compared = 0;
+        while (compared < chunk)
+        {
+            uint32_t virtual_address = second->virtual_address + offset + compared;
+            uint32_t run = std::min(page_size - (virtual_address & (page_size - 1)), chunk - compared);
+            int physical_address = page_table->getPhysicalAddress(pid, virtual_address);
+            translations++;
+            if (physical_address < 0)
+            {
+                fprintf(stderr, "error: page not mapped\n");
+                return -1;
+            }
+            size_t difference = firstDifference(buffer.data() + compared, (uint8_t *)memory + physical_address, run);
+            if (difference < run)
+            {
+                mmu->recordTranslations(pid, translations);
+                *element = (offset + compared + difference) / type_size;
+                return 1;
+            }
+            compared += run;
+        }
+    }
+    mmu->recordTranslations(pid, translations);
+    *element = size / type_size;
+    return first->size != second->size ? 1 : 0;
+}
+
+// Upper bound on the frames that compacting a process as planned takes,
+// minus the frames it frees. Writing data to a page without a frame of its
+// own (zero, shared or swapped out) may take one, and so may reading data
+// from a swapped out page that is kept. Zeros moved from zero pages aren't
+// written. Releasing a page frees its frame unless another page shares it.
+static int compactionFrames(uint32_t pid, std::vector<Relocation> &moves, std::vector<uint32_t> &released_pages,
+                            PageTable *page_table)
+{
+    uint32_t page_size = page_table->_page_size;
+    int n = (int)log2(page_size); // n = number of bits for page offset
+    std::unordered_set<uint32_t> released(released_pages.begin(), released_pages.end());
+    std::unordered_set<uint32_t> counted;
+    int frames = 0;
+    int i;
+    for (i = 0; i < moves.size(); i++)
+    {
+        uint32_t size = moves[i].variable->size;
+        uint32_t offset = 0;
+        while (offset < size)
+        {
+            uint32_t run = page_size - ((moves[i].new_address + offset) & (page_size - 1));
+            if (run > size - offset)
+            {
+                run = size - offset;
+            }
+            bool data = false;
+            uint32_t page;
+            for (page = (moves[i].old_address + offset) >> n; page <= (moves[i].old_address + offset + run - 1) >> n; page++)
+            {
+                if (page_table->zeroPage(pid, page))
+                {
+                    continue;
+                }
+                data = true;
+                if (released.count(page) == 0 && page_table->getFrame(pid, page) == -2 && counted.insert(page).second)
+                {
+                    frames++;
+                }
+            }
+            page = (moves[i].new_address + offset) >> n;
+            if (data && counted.insert(page).second && !page_table->ownsFrame(pid, page))
+            {
+                frames++;
+            }
+            offset += run;
+        }
+    }
+    for (i = 0; i < released_pages.size(); i++)
+    {
+        if (page_table->ownsFrame(pid, released_pages[i]))
+        {
+            frames--;
+        }
+    }
+    return frames;
+}
+
+// Compact a process (see Mmu::compactProcess), carrying the contents of the
+// moved variables along one page-contiguous run at a time, and unmap the
+// pages left empty
+static void moveVariables(uint32_t pid, Mmu *mmu, PageTable *page_table, void *memory)
+{
+    int frames = page_table->framesInUse();
+    std::vector<Relocation> moves;
+    std::vector<uint32_t> released_pages;
+    if (!mmu->compactProcess(pid, moves, released_pages))
+    {
+        fprintf(stderr, "error: can't compact process\n");
+        return;
+    }
+
+    // Read every moved variable from its old place before anything is
+    // overwritten, since old and new places may overlap
+    std::vector<std::vector<uint8_t> > contents(moves.size());
+    int i;
+    for (i = 0; i < moves.size(); i++)
+    {
+        Variable old = *moves[i].variable;
+        old.virtual_address = moves[i].old_address;
+        contents[i].resize(old.size);
+        copyElements(pid, &old, 0, contents[i].data(), old.size, false, page_table, memory);
+    }
+    for (i = 0; i < released_pages.size(); i++)
+    {
+        page_table->freeFrame(pid, released_pages[i]);
+    }
+
+    // Write the runs whose contents change, so that pages which stay zero
+    // keep sharing the zero frame
+    uint32_t page_size = page_table->_page_size;
+    int n = (int)log2(page_size); // n = number of bits for page offset
+    std::vector<uint8_t> current(page_size);
+    for (i = 0; i < moves.size(); i++)
+    {
+        Variable *var = moves[i].variable;
+        if (var->size == 0)
+        {
+            continue;
+        }
+        page_table->addRange(pid, var->virtual_address >> n, (var->virtual_address + var->size - 1) >> n);
+        uint32_t offset = 0;
+        while (offset < var->size)
+        {
+            uint32_t run = page_size - ((var->virtual_address + offset) & (page_size - 1));
+            if (run > var->size - offset)
+            {
+                run = var->size - offset;
+            }
+            copyElements(pid, var, offset, current.data(), run, false, page_table, memory);
+            if (memcmp(current.data(), contents[i].data() + offset, run) != 0)
+            {
+                copyElements(pid, var, offset, contents[i].data() + offset, run, true, page_table, memory);
+            }
+            offset += run;
+        }
+    }
+    int reclaimed = frames - (int)page_table->framesInUse();
+    printf("compacted %u: moved %d variables, released %d pages, reclaimed %d frames\n", pid, (int)moves.size(),
+           (int)released_pages.size(), reclaimed);
+}
+
+// Move the live variables of a process to the low end of its address space
+// and unmap the pages left empty, unless that would take more frames than
+// it frees. "compact <PID>"
+void compactProcess(uint32_t pid, Mmu *mmu, PageTable *page_table, void *memory)
+{
+    OpTimer timer(mmu, SimOp::OpCompact);
+    if (pidExists(pid, mmu) == false)
+    {
+        fprintf(stderr, "error: process not found\n");
+        return;
+    }
+    std::vector<Relocation> moves;
+    std::vector<uint32_t> released_pages;
+    if (!mmu->planCompaction(pid, moves, released_pages))
+    {
+        fprintf(stderr, "error: can't compact process\n");
+        return;
+    }
+    if (compactionFrames(pid, moves, released_pages, page_table) > 0)
+    {
+        fprintf(stderr, "error: compacting process would take more frames than it frees\n");
+        return;
+    }
+    moveVariables(pid, mmu, page_table, memory);
+}
+
+// Compact a process if its unused page space is over the Mmu's automatic
+// threshold and compacting it takes no more frames than it frees
+void compactIfFragmented(uint32_t pid, Mmu *mmu, PageTable *page_table, void *memory)
+{
+    if (!mmu->needsCompaction(pid))
+    {
+        return;
+    }
+    OpTimer timer(mmu, SimOp::OpCompact);
+    std::vector<Relocation> moves;
+    std::vector<uint32_t> released_pages;
+    if (mmu->planCompaction(pid, moves, released_pages) &&
+        compactionFrames(pid, moves, released_pages, page_table) <= 0)
+    {
+        moveVariables(pid, mmu, page_table, memory);
+    }
+}
+
+// Parse tokens[first..] into `values`, returns false if one isn't valid
+template <typename T>
+static bool parseElements(std::vector<const char *> &tokens, int first, std::vector<T> &values)
+{
+    values.resize(tokens.size() - first);
+    int i;
+    for (i = first; i < tokens.size(); i++)
+    {
+        if (!parseElement(tokens[i], &values[i - first]))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Parse the values of a `set` command, tokens[first..], into `values` as
+// elements of `type`. Returns false if a value isn't valid for the type
+struct ParseKernel {
+    template <typename T>
+    static void run(std::vector<const char *> &tokens, int first, std::vector<uint8_t> &values, bool *ok)
+    {
+        std::vector<T> elements;
+        *ok = parseElements(tokens, first, elements);
+        const uint8_t *bytes = (const uint8_t *)elements.data();
+        values.assign(bytes, bytes + elements.size() * sizeof(T));
+    }
+};
+
+bool parseValues(DataType type, std::vector<const char *> &tokens, int first, std::vector<uint8_t> &values)
+{
+    bool ok = false;
+    return dispatchElementType<ParseKernel>(type, tokens, first, values, &ok) && ok;
+}
+
+struct SetKernel {
+    template <typename T>
+    static void run(uint32_t pid, std::string &var_name, uint32_t offset, std::vector<const char *> &tokens, int first,
+                    Mmu *mmu, PageTable *page_table, void *memory, int *written)
+    {
+        std::vector<T> values;
+        if (!parseElements(tokens, first, values))
+        {
+            fprintf(stderr, "error: bad input\n");
+            return;
+        }
+        *written = writeVariable<T>(pid, var_name, offset, values.data(), values.size(), mmu, page_table, memory);
+    }
+};
+
+int setVariable(uint32_t pid, std::string var_name, uint32_t offset, std::vector<const char *> &tokens, int first,
+                Mmu *mmu, PageTable *page_table, void *memory)
+{
+    Variable *var = findSetTarget(pid, var_name, offset, mmu);
+    if (var == NULL)
+    {
+        return -1;
+    }
+    int written = -1;
+    if (!dispatchElementType<SetKernel>(var->type, pid, var_name, offset, tokens, first, mmu, page_table, memory, &written))
+    {
+        fprintf(stderr, "error: wrong data type\n");
+    }
+    return written;
+}
+
+// Print up to the first 4 elements of a variable
+struct PrintKernel {
+    template <typename T>
+    static void run(uint32_t pid, std::string &var_name, int num_elements, Mmu *mmu, PageTable *page_table, void *memory)
+    {
+        T values[4];
+        int shown = num_elements < 4 ? num_elements : 4;
+        if (readVariable<T>(pid, var_name, 0, values, shown, mmu, page_table, memory) < 0)
+        {
+            return;
+        }
+        int i;
+        for (i = 0; i < shown; i++)
+        {
+            if (i != (num_elements - 1))
+                std::cout << values[i] << ", ";
+            else
+                std::cout << values[i] << "\n";
+        }
+    }
+};
+
+// Print the first elements of a variable, "print <PID>:<var_name>"
+void printVariable(uint32_t pid, std::string var_name, Mmu *mmu, PageTable *page_table, void *memory)
+{
+    OpTimer timer(mmu, SimOp::OpRead);
+    Variable *var = mmu->getVariable(pid, var_name);
+    if (pidExists(pid, mmu) == false)
+    {
+        fprintf(stderr, "error: process not found\n");
+        return;
+    }
+    else if (var == NULL)
+    {
+        fprintf(stderr, "error: variable not found\n");
+        return;
+    }
+    if (var->type == DataType::FreeSpace)
+    {
+        fprintf(stderr, "error: can't print Free Space\n");
+        return;
+    }
+    int num_elements = var->size / mmu->sizeOfType(var->type);
+    if (!dispatchElementType<PrintKernel>(var->type, pid, var_name, num_elements, mmu, page_table, memory))
+    {
+        fprintf(stderr, "error: wrong data type");
+        return;
+    }
+    // If variable has more than 4 elements, just print the first 4 followed by "... [N items]"
+    // (where N is the number of elements)
+    if (num_elements > 4)
+    {
+        printf("... [%d items]\n", num_elements);
+    }
+}
@@ -1,284 +1,801 @@
 #include "mmu.h"
 #include "pagetable.h"
+#include "image.h"
 #include <sstream>
 #include <iomanip>
 #include <math.h>
+#include <cstring>
+#include <algorithm>
 
-Mmu::Mmu(int memory_size)
+Mmu::Mmu(int memory_size, uint32_t page_size, AllocPolicy policy)
 {
     _next_pid = 1024;
     _max_size = memory_size;
+    _page_size = page_size;
+    _page_shift = (int)log2(page_size);
+    _policy = policy;
+    _compact_threshold = -1;
+    _first_process = NULL;
+    _last_process = NULL;
+    memset(&_stats, 0, sizeof(_stats));
+    memset(_latency, 0, sizeof(_latency));
+    memset(&_page_usage, 0, sizeof(_page_usage));
 }
 
 Mmu::~Mmu()
 {
+    while (_first_process != NULL)
+    {
+        Process *proc = _first_process;
+        _first_process = proc->next;
+        delete proc->free_space;
+        _process_pool.release(proc);
+    }
+}
+
+// Get a process given its pid, or NULL if it doesn't exist
+Process* Mmu::getProcess(uint32_t pid)
+{
+    std::unordered_map<uint32_t, Process*>::iterator it = _process_index.find(pid);
+    if (it == _process_index.end())
+    {
+        return NULL;
+    }
+    return it->second;
+}
+
+// Add a process to the registry, after every live process
+void Mmu::registerProcess(Process *proc)
+{
+    proc->prev = _last_process;
+    proc->next = NULL;
+    if (_last_process != NULL)
+    {
+        _last_process->next = proc;
+    }
+    else
+    {
+        _first_process = proc;
+    }
+    _last_process = proc;
+    _process_index[proc->pid] = proc;
+}
+
+void Mmu::unregisterProcess(Process *proc)
+{
+    if (proc->prev != NULL)
+    {
+        proc->prev->next = proc->next;
+    }
+    else
+    {
+        _first_process = proc->next;
+    }
+    if (proc->next != NULL)
+    {
+        proc->next->prev = proc->prev;
+    }
+    else
+    {
+        _last_process = proc->prev;
+    }
+    _process_index.erase(proc->pid);
+}
+
+bool Mmu::hasProcess(uint32_t pid)
+{
+    return getProcess(pid) != NULL;
+}
+
+// Pids of the live processes, in creation order
+void Mmu::processIds(std::vector<uint32_t> &pids)
+{
+    Process *proc;
+    for (proc = _first_process; proc != NULL; proc = proc->next)
+    {
+        pids.push_back(proc->pid);
+    }
 }
 
 // removes the specified process from the mmu
 void Mmu::deleteProcess(uint32_t pid)
 {
-    int i;
-    for (i = 0; i < _processes.size(); i++)
+    Process *proc = getProcess(pid);
+    if (proc == NULL)
     {
-        if (_processes[i]->pid == pid)
-        {
-            _processes.erase(_processes.begin() + i);
-        }
+        return;
     }
+    unregisterProcess(proc);
+    _stats.bytes_live -= proc->stats.bytes_live;
+    addPageUsage(proc->page_usage, false);
+    // Releasing the process also releases its whole variable pool in one step
+    delete proc->free_space;
+    _process_pool.release(proc);
+}
+
+// Add a variable to the list of its process, after every live variable
+static void linkVariable(Process *proc, Variable *var)
+{
+    var->prev = proc->last_variable;
+    var->next = NULL;
+    if (proc->last_variable != NULL)
+    {
+        proc->last_variable->next = var;
+    }
+    else
+    {
+        proc->first_variable = var;
+    }
+    proc->last_variable = var;
+    proc->variable_count++;
+}
+
+// Take a variable off the list of its process
+static void unlinkVariable(Process *proc, Variable *var)
+{
+    if (var->prev != NULL)
+    {
+        var->prev->next = var->next;
+    }
+    else
+    {
+        proc->first_variable = var->next;
+    }
+    if (var->next != NULL)
+    {
+        var->next->prev = var->prev;
+    }
+    else
+    {
+        proc->last_variable = var->prev;
+    }
+    proc->variable_count--;
 }
 
 uint32_t Mmu::createProcess()
 {
-    Process *proc = new Process();
+    Process *proc = _process_pool.allocate();
     proc->pid = _next_pid;
+    proc->free_space = new FreeList(_max_size, _policy);
 
-    Variable *var = new Variable();
-    var->name = "<FREE_SPACE>";
-    var->type = DataType::FreeSpace;
-    var->virtual_address = 0;
-    var->size = _max_size;
-    proc->variables.push_back(var);
-
-    _processes.push_back(proc);
+    registerProcess(proc);
 
     _next_pid++;
     return proc->pid;
 }
 
+// Pid the next created or forked process gets
+uint32_t Mmu::nextPid()
+{
+    return _next_pid;
+}
+
+// Pids are handed out in order by one Mmu, or by the trace replay engine
+// when processes are spread over the Mmus of several shards
+void Mmu::setNextPid(uint32_t pid)
+{
+    _next_pid = pid;
+}
+
+// Creates a new process with a copy of the variables and free space of
+// `pid`, returns the new pid or -1 if the process doesn't exist
+int Mmu::forkProcess(uint32_t pid)
+{
+    Process *parent = getProcess(pid);
+    if (parent == NULL)
+    {
+        return -1;
+    }
+    Process *child = _process_pool.allocate();
+    child->pid = _next_pid;
+    child->free_space = new FreeList(*parent->free_space);
+    child->stats.bytes_live = parent->stats.bytes_live;
+    _stats.bytes_live += child->stats.bytes_live;
+    child->page_bytes = parent->page_bytes;
+    child->page_usage = parent->page_usage;
+    addPageUsage(child->page_usage, true);
+    Variable *parent_var;
+    for (parent_var = parent->first_variable; parent_var != NULL; parent_var = parent_var->next)
+    {
+        Variable *var = child->variable_pool.allocate();
+        *var = *parent_var;
+        linkVariable(child, var);
+        child->variable_index[var->name] = var;
+    }
+
+    registerProcess(child);
+
+    _next_pid++;
+    return child->pid;
+}
+
 // Inputs: pid -> process pid
-//         var -> A FreeSpace variable
+//         var -> A variable that has just been freed
 //
-// Check if the variable just before or just after `var` are also free space 
-// if so merge them into one larger free space
+// Remove `var` from the process and give its space back to the free list,
+// which merges it with the free space just before or just after it
 void Mmu::mergeFreeSpace(uint32_t pid, Variable *var)
 {
-    int i;
-    int index = 0;
-    Process *proc = NULL;
-    Variable *var1 = NULL;
-    Variable *var2 = NULL;
-    // Search for `var`
-    for (i = 0; i < _processes.size(); i++)
-    {
-        if (_processes[i]->pid == pid)
+    Process *proc = getProcess(pid);
+    if (proc == NULL)
+    {
+        return;
+    }
+
+    proc->variable_index.erase(var->name);
+    unlinkVariable(proc, var);
+    int merged = proc->free_space->release(var->virtual_address, var->size);
+    addPageBytes(proc, var->virtual_address, var->size, false);
+    proc->stats.frees++;
+    proc->stats.coalesces += merged;
+    proc->stats.bytes_live -= var->size;
+    _stats.frees++;
+    _stats.coalesces += merged;
+    _stats.bytes_live -= var->size;
+    proc->variable_pool.release(var);
+}
+
+// Bytes of live variables on a page of a process, 0 once no variable
+// uses the page (or the process doesn't exist)
+uint32_t Mmu::pageBytes(uint32_t pid, uint32_t page_number)
+{
+    Process *proc = getProcess(pid);
+    if (proc == NULL)
+    {
+        return 0;
+    }
+    std::unordered_map<uint32_t, uint32_t>::iterator it = proc->page_bytes.find(page_number);
+    return it != proc->page_bytes.end() ? it->second : 0;
+}
+
+// Get a variable given the process id and the variable name
+Variable* Mmu::getVariable(uint32_t pid, std::string name)
+{
+    Process *proc = getProcess(pid);
+    if (proc == NULL)
+    {
+        return NULL;
+    }
+    // A name that was never interned can't belong to any variable
+    std::unordered_set<std::string>::iterator interned = _names.find(name);
+    if (interned == _names.end())
+    {
+        return NULL;
+    }
+    std::unordered_map<const std::string*, Variable*>::iterator it = proc->variable_index.find(&*interned);
+    if (it == proc->variable_index.end())
+    {
+        return NULL;
+    }
+    return it->second;
+}
+
+// Reserve `size` bytes of the process's free space according to the allocation policy
+// Returns the virtual address of the reserved space, or -1 if there is not enough
+int Mmu::findFreeSpace(uint32_t pid, uint32_t size)
+{
+    Process *proc = getProcess(pid);
+    if (proc == NULL)
+    {
+        return -1;
+    }
+    return proc->free_space->allocate(size);
+}
+
+void Mmu::addVariableToProcess(uint32_t pid, std::string var_name, DataType type, uint32_t size, uint32_t address)
+{
+    Process *proc = getProcess(pid);
+    if (proc == NULL)
+    {
+        return;
+    }
+
+    Variable *var = proc->variable_pool.allocate();
+    var->name = &*_names.insert(var_name).first;
+    var->type = type;
+    var->virtual_address = address;
+    var->size = size;
+    linkVariable(proc, var);
+    proc->variable_index[var->name] = var;
+    proc->stats.allocations++;
+    proc->stats.bytes_live += size;
+    _stats.allocations++;
+    _stats.bytes_live += size;
+    addPageBytes(proc, address, size, true);
+}
+
+// Fill bucket of a page holding `bytes` bytes of live variables
+static int pageFillBucket(uint32_t bytes, uint32_t page_size)
+{
+    return bytes >= page_size ? PAGE_FILL_BUCKETS - 1 : (int)((uint64_t)bytes * (PAGE_FILL_BUCKETS - 1) / page_size);
+}
+
+// Add (or remove) the bytes [address, address + size) of a variable to the
+// pages it lies on, updating the page usage of the process and the totals
+void Mmu::addPageBytes(Process *proc, uint32_t address, uint32_t size, bool add)
+{
+    if (size == 0)
+    {
+        return;
+    }
+    addPageUsage(proc->page_usage, false);
+    PageUsage &usage = proc->page_usage;
+    uint64_t end = (uint64_t)address + size;
+    uint32_t page;
+    for (page = address >> _page_shift; page <= (end - 1) >> _page_shift; page++)
+    {
+        uint64_t page_start = (uint64_t)page << _page_shift;
+        uint64_t page_end = page_start + _page_size;
+        uint32_t overlap = (uint32_t)(std::min(end, page_end) - std::max((uint64_t)address, page_start));
+        uint32_t &bytes = proc->page_bytes[page];
+        if (bytes > 0)
+        {
+            usage.fill[pageFillBucket(bytes, _page_size)]--;
+        }
+        else
+        {
+            usage.pages++;
+            usage.unused_bytes += _page_size;
+        }
+        if (add)
+        {
+            bytes += overlap;
+            usage.unused_bytes -= overlap;
+        }
+        else
+        {
+            bytes -= overlap;
+            usage.unused_bytes += overlap;
+        }
+        if (bytes > 0)
+        {
+            usage.fill[pageFillBucket(bytes, _page_size)]++;
+        }
+        else
         {
-            proc = _processes[i];
-            for (i = 0; i < proc->variables.size(); i++)
-            {
-                if (proc->variables[i]->virtual_address == var->virtual_address)
-                {   
-                    // get `var` index and variables above and below if they exist
-                    index = i;
-                    if (i < proc->variables.size() - 1)
-                    {
-                        var1 = proc->variables[i+1];
-                    }
-                    if (i > 0)                   
-                    {
-                        var2 = proc->variables[i-1];
-                    }
-                    break;
-                }
-            }
+            usage.pages--;
+            usage.unused_bytes -= _page_size;
+            proc->page_bytes.erase(page);
         }
-        break;
     }
-    // Merge free space(s)
-    if (var1 != NULL)
+    addPageUsage(proc->page_usage, true);
+}
+
+// Add (or remove) the page usage of a process to the totals
+void Mmu::addPageUsage(const PageUsage &usage, bool add)
+{
+    int sign = add ? 1 : -1;
+    _page_usage.pages += sign * usage.pages;
+    _page_usage.unused_bytes += sign * (int64_t)usage.unused_bytes;
+    int i;
+    for (i = 0; i < PAGE_FILL_BUCKETS; i++)
+    {
+        _page_usage.fill[i] += sign * usage.fill[i];
+    }
+}
+
+// Counters of a process, or NULL if it doesn't exist
+MmuStats* Mmu::processStats(uint32_t pid)
+{
+    Process *proc = getProcess(pid);
+    return proc != NULL ? &proc->stats : NULL;
+}
+
+MmuStats* Mmu::stats()
+{
+    return &_stats;
+}
+
+void Mmu::recordFailedAllocation(uint32_t pid)
+{
+    Process *proc = getProcess(pid);
+    if (proc != NULL)
+    {
+        proc->stats.failed_allocations++;
+    }
+    _stats.failed_allocations++;
+}
+
+void Mmu::recordTranslations(uint32_t pid, uint32_t count)
+{
+    Process *proc = getProcess(pid);
+    if (proc != NULL)
     {
-        if (var1->type == DataType::FreeSpace)
+        proc->stats.translations += count;
+    }
+    _stats.translations += count;
+}
+
+void Mmu::recordLatency(SimOp op, uint64_t ns)
+{
+    ::recordLatency(&_latency[op], ns);
+}
+
+const LatencyHistogram* Mmu::latency(SimOp op)
+{
+    return &_latency[op];
+}
+
+void Mmu::print()
+{
+    std::cout << " PID  | Variable Name | Virtual Addr | Size" << "\n";
+    std::cout << "------+---------------+--------------+------------" << "\n";
+
+    Process *proc;
+    for (proc = _first_process; proc != NULL; proc = proc->next)
+    {
+        Variable *var;
+        for (var = proc->first_variable; var != NULL; var = var->next)
         {
-            var->size += var1->size;
-            proc->variables.erase(proc->variables.begin() + index + 1);
-            
-            var->virtual_address = var1->virtual_address;
+            uint32_t pid = proc->pid;
+            const std::string &name = *var->name;
+            uint32_t virtual_addr = var->virtual_address;
+            std::stringstream sstream;
+            sstream << "0x" << std::setfill('0') << std::setw(8) << std::uppercase << std::hex << virtual_addr;
+            std::string result = sstream.str();
+            uint32_t size = var->size;
+            printf("%5u | %-13s | %12s | %10u\n", pid, name.c_str(), result.c_str(), size);
         }
     }
-    if (var2 != NULL)
+}
+
+void Mmu::printFreeSpace()
+{
+    std::cout << " PID  | Policy     | Free Bytes | Free Blocks | Largest Block | Internal | External Frag" << "\n";
+    std::cout << "------+------------+------------+-------------+---------------+----------+---------------" << "\n";
+
+    Process *proc;
+    for (proc = _first_process; proc != NULL; proc = proc->next)
     {
-        if (var2->type == DataType::FreeSpace)
+        FragmentationMetrics m = proc->free_space->metrics();
+        printf("%5u | %-10s | %10u | %11u | %13u | %8u | %12.2f%%\n", proc->pid,
+               allocPolicyName(proc->free_space->policy()), m.free_bytes, m.free_blocks,
+               m.largest_free_block, m.internal_bytes, 100.0 * m.external_fragmentation);
+    }
+}
+
+static bool variableAddressLess(const Variable *a, const Variable *b)
+{
+    return a->virtual_address < b->virtual_address;
+}
+
+// Buddy blocks pack without gaps when the largest are placed first
+static bool variableSizeGreater(const Variable *a, const Variable *b)
+{
+    return a->size > b->size || (a->size == b->size && a->virtual_address < b->virtual_address);
+}
+
+// Place the live variables of a process in a fresh free list, in address
+// order (size order for the buddy policy), so that they end up at the low
+// end of its address space. Fills `order` with the variables and
+// `addresses` with their new places. Returns NULL if they don't fit again.
+FreeList* Mmu::packVariables(Process *proc, std::vector<Variable*> &order, std::vector<int> &addresses)
+{
+    order.reserve(proc->variable_count);
+    Variable *var;
+    for (var = proc->first_variable; var != NULL; var = var->next)
+    {
+        order.push_back(var);
+    }
+    std::sort(order.begin(), order.end(), _policy == AllocPolicy::Buddy ? variableSizeGreater : variableAddressLess);
+    FreeList *packed = new FreeList(_max_size, _policy);
+    addresses.resize(order.size());
+    int i;
+    for (i = 0; i < order.size(); i++)
+    {
+        addresses[i] = packed->allocate(order[i]->size);
+        if (addresses[i] < 0)
         {
-            var->size += var2->size;
-            proc->variables.erase(proc->variables.begin() + index - 1);
+            delete packed;
+            return NULL;
         }
     }
+    return packed;
 }
 
-// Check if any variables in a process have the same page number as `var`
-// If so, return true, otherwise return false 
-bool Mmu::isVariableInOwnPage(uint32_t pid, Variable* var, int page_number, PageTable *page_table)
+// Work out what compactProcess() would do without changing anything: appends
+// every variable it would move to `moves`, and every page that would no
+// longer hold any variable to `released_pages`. Returns false if the process
+// doesn't exist or the variables don't fit again.
+bool Mmu::planCompaction(uint32_t pid, std::vector<Relocation> &moves, std::vector<uint32_t> &released_pages)
 {
-    Process *proc = NULL;
-    int var_page_number = 0;
-    int var_next_page_number = 0;
-    int n = (int)log2(page_table->_page_size); // n = number of bits for page offset
+    Process *proc = getProcess(pid);
+    if (proc == NULL)
+    {
+        return false;
+    }
+    std::vector<Variable*> order;
+    std::vector<int> addresses;
+    FreeList *packed = packVariables(proc, order, addresses);
+    if (packed == NULL)
+    {
+        return false;
+    }
+    delete packed;
 
+    std::unordered_set<uint32_t> kept_pages;
     int i;
-    for (i = 0; i < _processes.size(); i++)
+    for (i = 0; i < order.size(); i++)
+    {
+        if (order[i]->virtual_address != addresses[i])
+        {
+            Relocation move = {order[i], order[i]->virtual_address, (uint32_t)addresses[i]};
+            moves.push_back(move);
+        }
+        uint64_t end = (uint64_t)addresses[i] + order[i]->size;
+        uint32_t page;
+        for (page = addresses[i] >> _page_shift; order[i]->size > 0 && page <= (end - 1) >> _page_shift; page++)
+        {
+            kept_pages.insert(page);
+        }
+    }
+    std::unordered_map<uint32_t, uint32_t>::iterator page;
+    for (page = proc->page_bytes.begin(); page != proc->page_bytes.end(); page++)
     {
-        if (_processes[i]->pid == pid)
+        if (kept_pages.count(page->first) == 0)
         {
-            proc = _processes[i];
-            for (i = 0; i < proc->variables.size(); i++)
-            {
-                // Get page number of variable
-                var_page_number = proc->variables[i]->virtual_address >> n;
-                var_next_page_number = proc->variables[i]->virtual_address + proc->variables[i]->size - 1 >> n;
-                while (var_page_number <= var_next_page_number)
-                {
-                    if (proc->variables[i]->name.compare("<FREE_SPACE>") == 0 || var->name.compare(proc->variables[i]->name) == 0)
-                    {
-                        break;
-                    }
-
-                    if (page_number == var_page_number)
-                    {
-                        return false;
-                    }
-                    var_page_number++;
-                }
-            }
+            released_pages.push_back(page->first);
         }
-        break;
     }
+    std::sort(released_pages.begin(), released_pages.end());
     return true;
 }
 
-// Get a variable given the process id and the variable name
-Variable* Mmu::getVariable(uint32_t pid, std::string name)
+// Move the live variables of a process to the low end of its address space
+// (see packVariables()). Appends every variable that moved to `moves`, and
+// every page that no longer holds any variable to `released_pages`. Moving
+// the contents and the mappings is up to the caller. Returns false, changing
+// nothing, if the process doesn't exist or the variables don't fit again.
+bool Mmu::compactProcess(uint32_t pid, std::vector<Relocation> &moves, std::vector<uint32_t> &released_pages)
 {
-    Process *proc = NULL;
-    Variable *var = NULL;
+    Process *proc = getProcess(pid);
+    if (proc == NULL)
+    {
+        return false;
+    }
+    std::vector<Variable*> order;
+    std::vector<int> addresses;
+    FreeList *packed = packVariables(proc, order, addresses);
+    if (packed == NULL)
+    {
+        return false;
+    }
     int i;
-    for (i = 0; i < _processes.size(); i++)
+    delete proc->free_space;
+    proc->free_space = packed;
+
+    std::unordered_map<uint32_t, uint32_t> old_pages = proc->page_bytes;
+    for (i = 0; i < order.size(); i++)
     {
-        if (_processes[i]->pid == pid)
+        if (order[i]->virtual_address != addresses[i])
         {
-            proc = _processes[i];
-            for (i = 0; i < proc->variables.size(); i++)
-            {
-                if (proc->variables[i]->name.compare(name) == 0)
-                {
-                    var = proc->variables[i];
-                    break;
-                }
-            }
-            break;
+            addPageBytes(proc, order[i]->virtual_address, order[i]->size, false);
         }
     }
-    return var;
+    for (i = 0; i < order.size(); i++)
+    {
+        if (order[i]->virtual_address != addresses[i])
+        {
+            Relocation move = {order[i], order[i]->virtual_address, (uint32_t)addresses[i]};
+            moves.push_back(move);
+            order[i]->virtual_address = addresses[i];
+            addPageBytes(proc, addresses[i], order[i]->size, true);
+        }
+    }
+    std::unordered_map<uint32_t, uint32_t>::iterator page;
+    for (page = old_pages.begin(); page != old_pages.end(); page++)
+    {
+        if (proc->page_bytes.count(page->first) == 0)
+        {
+            released_pages.push_back(page->first);
+        }
+    }
+    std::sort(released_pages.begin(), released_pages.end());
+    return true;
+}
+
+// Compact a process automatically once more than `percent` percent of the
+// space of its mapped pages is unused, or never if `percent` is -1
+void Mmu::setCompactThreshold(int percent)
+{
+    _compact_threshold = percent;
 }
 
-// Add array fit on part of page
-Variable* Mmu::findFreeSpace(uint32_t pid, uint32_t size)
+// True if the automatic threshold is set, the process is over it and
+// compacting it could release at least one page
+bool Mmu::needsCompaction(uint32_t pid)
 {
-    Process *proc = NULL;
-    Variable *var = NULL;
+    Process *proc = getProcess(pid);
+    if (proc == NULL || _compact_threshold < 0 || proc->page_usage.unused_bytes < _page_size)
+    {
+        return false;
+    }
+    uint64_t mapped = (uint64_t)proc->page_usage.pages * _page_size;
+    return proc->page_usage.unused_bytes * 100 > mapped * _compact_threshold;
+}
+
+// Header of a table with one column per process, NULL standing for the totals
+static void printProcessColumns(const char *title, std::vector<Process*> &shown)
+{
+    printf("\n %-23s", title);
     int i;
-    for (i = 0; i < _processes.size(); i++)
+    for (i = 0; i < shown.size(); i++)
     {
-        if (_processes[i]->pid == pid)
+        if (shown[i] != NULL)
+        {
+            printf(" | %7u", shown[i]->pid);
+        }
+        else
         {
-            proc = _processes[i];
-            for (i = 0; i < proc->variables.size(); i++)
-            {
-                if (proc->variables[i]->type == DataType::FreeSpace && 
-                    proc->variables[i]->size >= size)
-                {
-                    var = proc->variables[i];
-                    var->size -= size;
-                    break;
-                }
-            }
-            break;
+            printf(" | %7s", "all");
         }
     }
-    return var;
+    std::cout << "\n" << "------------------------" << std::string(10 * shown.size(), '-') << "\n";
 }
 
-void Mmu::addVariableToProcess(uint32_t pid, std::string var_name, DataType type, uint32_t size, uint32_t address)
+// Fragmentation of the processes (or of process `pid` only, if it isn't -1):
+// external fragmentation of the free space, space the allocation policy
+// rounds up, space of mapped pages that no variable uses, and the free block
+// sizes and page fill levels behind them. Every figure is kept up to date by
+// the free lists and addPageBytes(), so no variables are scanned
+void Mmu::printFragmentation(int pid)
 {
-    int i;
-    Process *proc = NULL;
-    for (i = 0; i < _processes.size(); i++)
+    std::vector<Process*> shown;
+    std::vector<FragmentationMetrics> metrics;
+    FragmentationMetrics total;
+    memset(&total, 0, sizeof(total));
+    uint64_t largest_sum = 0;
+    int i, j;
+    Process *proc;
+    for (proc = _first_process; proc != NULL; proc = proc->next)
     {
-        if (_processes[i]->pid == pid)
+        if (pid != -1 && proc->pid != pid)
         {
-            proc = _processes[i];
-            break;
+            continue;
         }
+        FragmentationMetrics m = proc->free_space->metrics();
+        shown.push_back(proc);
+        metrics.push_back(m);
+        total.free_bytes += m.free_bytes;
+        total.free_blocks += m.free_blocks;
+        total.largest_free_block = std::max(total.largest_free_block, m.largest_free_block);
+        largest_sum += m.largest_free_block;
+        total.internal_bytes += m.internal_bytes;
+        for (j = 0; j < FREE_SIZE_CLASSES; j++)
+        {
+            total.size_classes[j] += m.size_classes[j];
+        }
+    }
+    // Processes have separate address spaces, so in total the free space is
+    // unfragmented when every process has a single free block
+    total.external_fragmentation = total.free_bytes > 0 ? 1.0 - (double)largest_sum / total.free_bytes : 0.0;
+    // The totals column is left out when it would repeat a single process
+    bool with_total = pid == -1;
+    if (with_total)
+    {
+        shown.push_back(NULL);
+        metrics.push_back(total);
     }
 
-    Variable *var = new Variable();
-    var->name = var_name;
-    var->type = type;
-    var->virtual_address = address;
-    var->size = size;
-    if (proc != NULL)
+    std::cout << " PID  | Free Bytes | Free Blocks | Largest Block | External | Internal | Pages | Unused Bytes | Page Waste" << "\n";
+    std::cout << "------+------------+-------------+---------------+----------+----------+-------+--------------+-----------" << "\n";
+    for (i = 0; i < shown.size(); i++)
     {
-        proc->variables.push_back(var);
+        MmuStats *stats = shown[i] != NULL ? &shown[i]->stats : &_stats;
+        PageUsage *usage = shown[i] != NULL ? &shown[i]->page_usage : &_page_usage;
+        uint64_t reserved = stats->bytes_live + metrics[i].internal_bytes;
+        uint64_t mapped = (uint64_t)usage->pages * _page_size;
+        if (shown[i] != NULL)
+        {
+            printf("%5u", shown[i]->pid);
+        }
+        else
+        {
+            printf("  all");
+        }
+        printf(" | %10u | %11u | %13u | %7.2f%% | %7.2f%% | %5u | %12llu | %8.2f%%\n", metrics[i].free_bytes,
+               metrics[i].free_blocks, metrics[i].largest_free_block, 100.0 * metrics[i].external_fragmentation,
+               reserved > 0 ? 100.0 * metrics[i].internal_bytes / reserved : 0.0, usage->pages,
+               (unsigned long long)usage->unused_bytes, mapped > 0 ? 100.0 * usage->unused_bytes / mapped : 0.0);
+    }
+
+    // Free blocks per size class, only the classes some process has blocks in
+    printProcessColumns("Free Block Size", shown);
+    for (j = 0; j < FREE_SIZE_CLASSES; j++)
+    {
+        if (total.size_classes[j] == 0)
+        {
+            continue;
+        }
+        printf(" %10llu - %10llu", 1ULL << j, (2ULL << j) - 1);
+        for (i = 0; i < metrics.size(); i++)
+        {
+            printf(" | %7u", metrics[i].size_classes[j]);
+        }
+        std::cout << "\n";
+    }
+
+    // Pages per fill level
+    const char *fill_names[PAGE_FILL_BUCKETS] = {"under 25% used", "under 50% used", "under 75% used", "under 100% used", "full"};
+    printProcessColumns("Page Fill", shown);
+    for (j = 0; j < PAGE_FILL_BUCKETS; j++)
+    {
+        printf(" %-23s", fill_names[j]);
+        for (i = 0; i < shown.size(); i++)
+        {
+            PageUsage *usage = shown[i] != NULL ? &shown[i]->page_usage : &_page_usage;
+            printf(" | %7u", usage->fill[j]);
+        }
+        std::cout << "\n";
     }
 }
 
-void Mmu::print()
+void Mmu::saveImage(ImageWriter &out)
 {
-    int i, j;
-    std::cout << " PID  | Variable Name | Virtual Addr | Size" << std::endl;
-    std::cout << "------+---------------+--------------+------------" << std::endl;
+    out.put<uint32_t>(_next_pid);
+    out.put(_stats);
+    out.put<uint32_t>(_process_index.size());
+    Process *proc;
+    for (proc = _first_process; proc != NULL; proc = proc->next)
+    {
+        out.put<uint32_t>(proc->pid);
+        out.put(proc->stats);
+        out.put<uint8_t>(proc->free_space->policy());
+        out.put<uint32_t>(proc->variable_count);
+        Variable *var;
+        for (var = proc->first_variable; var != NULL; var = var->next)
+        {
+            out.writeString(*var->name);
+            out.put<uint8_t>(var->type);
+            out.put<uint32_t>(var->virtual_address);
+            out.put<uint32_t>(var->size);
+        }
+        proc->free_space->saveImage(out);
+    }
+}
 
-    for (i = 0; i < _processes.size(); i++)
+bool Mmu::loadImage(ImageReader &in)
+{
+    _next_pid = in.get<uint32_t>();
+    MmuStats stats = in.get<MmuStats>();
+    uint32_t processes = in.get<uint32_t>();
+    uint32_t p;
+    for (p = 0; p < processes && in.ok(); p++)
     {
-        for (j = 0; j < _processes[i]->variables.size(); j++)
+        Process *proc = _process_pool.allocate();
+        proc->pid = in.get<uint32_t>();
+        proc->stats = in.get<MmuStats>();
+        AllocPolicy policy = (AllocPolicy)in.get<uint8_t>();
+        proc->free_space = new FreeList(_max_size, policy <= AllocPolicy::Buddy ? policy : _policy);
+        registerProcess(proc);
+        uint32_t variables = in.get<uint32_t>();
+        uint32_t i;
+        for (i = 0; i < variables && in.ok(); i++)
         {
-            // TODO: print all variables (excluding <FREE_SPACE> entries)
-            if (_processes[i]->variables[j]->type == DataType::FreeSpace)
-            {
-                //continue;
-            }
-            uint32_t pid = _processes[i]->pid;
-            std::string name = _processes[i]->variables[j]->name;
-            uint32_t virtual_addr = _processes[i]->variables[j]->virtual_address;
-            std::stringstream sstream;
-            sstream << "0x" << std::setfill('0') << std::setw(8) << std::uppercase << std::hex << virtual_addr;
-            std::string result = sstream.str();
-            uint32_t size = _processes[i]->variables[j]->size;
-            printf("%5u | %-13s | %12s | %10u\n", pid, name.c_str(), result.c_str(), size);
+            Variable *var = proc->variable_pool.allocate();
+            var->name = &*_names.insert(in.readString()).first;
+            var->type = (DataType)in.get<uint8_t>();
+            var->virtual_address = in.get<uint32_t>();
+            var->size = in.get<uint32_t>();
+            linkVariable(proc, var);
+            proc->variable_index[var->name] = var;
+            addPageBytes(proc, var->virtual_address, var->size, true);
+        }
+        if (!proc->free_space->loadImage(in))
+        {
+            return false;
         }
     }
+    _stats = stats;
+    return in.ok();
 }
 
 DataType Mmu::stringToDataType(std::string string)
 {
-    if (string.compare("char") == 0) {
-        return DataType::Char;
-    } else if (string.compare("double") == 0) {
-        return DataType::Double;
-    } else if (string.compare("float") == 0) {
-        return DataType::Float;
-    } else if (string.compare("int") == 0) {
-        return DataType::Int;
-    } else if (string.compare("long") == 0) {
-        return DataType::Long;
-    } else if (string.compare("short") == 0) {
-        return DataType::Short;
-    } else {
-        return DataType::Err;
-    }
+    return dataTypeFromName(string.c_str());
 }
 
 uint32_t Mmu::sizeOfType(DataType type)
 {
-    if (type == DataType::Char) {
-        return 1;
-    } else if (type == DataType::Short) {
-        return 2;
-    } else if (type == DataType::Int || type == DataType::Float) {
-        return 4;
-    } else if (type == DataType::Double || type == DataType::Long) {
-        return 8;
-    } else if (type == DataType::FreeSpace) {
-        return 1;
-    } else {
-        return -1;
-    }
+    return dataTypeSize(type);
 }
\ No newline at end of file
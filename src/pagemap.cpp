@@ -0,0 +1,763 @@
+#include "pagemap.h"
+#include <cstring>
+
+PageMap::PageMap()
+{
+    _walks = 0;
+    _levels_walked = 0;
+}
+
+PageMap::~PageMap()
+{
+}
+
+uint64_t PageMap::walks()
+{
+    return _walks;
+}
+
+uint64_t PageMap::levelsWalked()
+{
+    return _levels_walked;
+}
+
+//
+// FlatPageMap
+//
+
+FlatPageMap::FlatPageMap()
+{
+    _last_pid = 0;
+    _last_pages = NULL;
+}
+
+FlatPageMap::~FlatPageMap()
+{
+}
+
+// Returns the translation array of a process, or NULL if it has no pages
+std::vector<int>* FlatPageMap::processPages(uint32_t pid)
+{
+    if (_last_pages != NULL && _last_pid == pid)
+    {
+        return _last_pages;
+    }
+
+    std::unordered_map<uint32_t, std::vector<int> >::iterator it = _table.find(pid);
+    if (it == _table.end())
+    {
+        return NULL;
+    }
+    _last_pid = pid;
+    _last_pages = &it->second;
+    return _last_pages;
+}
+
+int FlatPageMap::get(uint32_t pid, int page_number)
+{
+    _walks++;
+    _levels_walked++;
+    std::vector<int> *pages = processPages(pid);
+    if (pages == NULL || page_number < 0 || page_number >= pages->size())
+    {
+        return -1;
+    }
+    return (*pages)[page_number];
+}
+
+void FlatPageMap::set(uint32_t pid, int page_number, int frame)
+{
+    std::vector<int> *pages = processPages(pid);
+    if (pages == NULL)
+    {
+        pages = &_table[pid];
+        _last_pid = pid;
+        _last_pages = pages;
+    }
+    if (page_number >= pages->size())
+    {
+        pages->resize(page_number + 1, -1);
+    }
+    (*pages)[page_number] = frame;
+}
+
+int FlatPageMap::erase(uint32_t pid, int page_number)
+{
+    std::vector<int> *pages = processPages(pid);
+    if (pages == NULL || page_number < 0 || page_number >= pages->size())
+    {
+        return -1;
+    }
+    int frame = (*pages)[page_number];
+    (*pages)[page_number] = -1;
+    // Keep the array no longer than the highest mapped page, so that
+    // eraseProcess() scans no more than the span of the live pages
+    while (!pages->empty() && pages->back() < 0)
+    {
+        pages->pop_back();
+    }
+    return frame;
+}
+
+void FlatPageMap::eraseProcess(uint32_t pid, std::vector<int> &frames)
+{
+    std::unordered_map<uint32_t, std::vector<int> >::iterator it = _table.find(pid);
+    if (it == _table.end())
+    {
+        return;
+    }
+    int i;
+    for (i = 0; i < it->second.size(); i++)
+    {
+        if (it->second[i] >= 0)
+        {
+            frames.push_back(it->second[i]);
+        }
+    }
+    if (_last_pid == pid)
+    {
+        _last_pages = NULL;
+    }
+    _table.erase(it);
+}
+
+void FlatPageMap::entries(std::vector<PageMapEntry> &out)
+{
+    std::unordered_map<uint32_t, std::vector<int> >::iterator it;
+    for (it = _table.begin(); it != _table.end(); it++)
+    {
+        int page;
+        for (page = 0; page < it->second.size(); page++)
+        {
+            if (it->second[page] >= 0)
+            {
+                PageMapEntry entry = {it->first, page, it->second[page]};
+                out.push_back(entry);
+            }
+        }
+    }
+}
+
+size_t FlatPageMap::footprint()
+{
+    size_t bytes = 0;
+    std::unordered_map<uint32_t, std::vector<int> >::iterator it;
+    for (it = _table.begin(); it != _table.end(); it++)
+    {
+        bytes += sizeof(uint32_t) + sizeof(std::vector<int>) + it->second.capacity() * sizeof(int);
+    }
+    return bytes;
+}
+
+int FlatPageMap::levels()
+{
+    return 1;
+}
+
+//
+// RadixPageMap
+//
+
+// Split the page number bits of a 32-bit address over `levels` levels as
+// evenly as possible, the upper levels get any remainder
+static void splitPageNumber(int page_bits, int levels, int *bits, int *shift)
+{
+    int page_number_bits = 32 - page_bits;
+    int total = 0;
+    int level;
+    for (level = levels - 1; level >= 0; level--)
+    {
+        bits[level] = page_number_bits / levels + (level < page_number_bits % levels ? 1 : 0);
+        shift[level] = total;
+        total += bits[level];
+    }
+}
+
+RadixPageMap::RadixPageMap(int page_bits, int levels)
+{
+    if (levels < 2)
+    {
+        levels = 2;
+    }
+    if (levels > 4)
+    {
+        levels = 4;
+    }
+    _levels = levels;
+    _bytes = 0;
+    _last_pid = 0;
+    _last_root = NULL;
+
+    splitPageNumber(page_bits, _levels, _bits, _shift);
+}
+
+RadixPageMap::~RadixPageMap()
+{
+    std::unordered_map<uint32_t, RadixNode*>::iterator it;
+    for (it = _roots.begin(); it != _roots.end(); it++)
+    {
+        deleteNode(it->second, 0, NULL);
+    }
+}
+
+RadixNode* RadixPageMap::newNode(int level)
+{
+    RadixNode *node = new RadixNode();
+    node->used = 0;
+    size_t slots = (size_t)1 << _bits[level];
+    if (level == _levels - 1)
+    {
+        node->frames.resize(slots, -1);
+        _bytes += sizeof(RadixNode) + slots * sizeof(int);
+    }
+    else
+    {
+        node->children.resize(slots, NULL);
+        _bytes += sizeof(RadixNode) + slots * sizeof(RadixNode*);
+    }
+    return node;
+}
+
+// Deletes a node and everything below it, appending mapped frames to `frames` if given
+void RadixPageMap::deleteNode(RadixNode *node, int level, std::vector<int> *frames)
+{
+    int i;
+    if (level == _levels - 1)
+    {
+        if (frames != NULL)
+        {
+            for (i = 0; i < node->frames.size(); i++)
+            {
+                if (node->frames[i] >= 0)
+                {
+                    frames->push_back(node->frames[i]);
+                }
+            }
+        }
+        _bytes -= sizeof(RadixNode) + node->frames.size() * sizeof(int);
+    }
+    else
+    {
+        for (i = 0; i < node->children.size(); i++)
+        {
+            if (node->children[i] != NULL)
+            {
+                deleteNode(node->children[i], level + 1, frames);
+            }
+        }
+        _bytes -= sizeof(RadixNode) + node->children.size() * sizeof(RadixNode*);
+    }
+    delete node;
+}
+
+RadixNode* RadixPageMap::root(uint32_t pid)
+{
+    if (_last_root != NULL && _last_pid == pid)
+    {
+        return _last_root;
+    }
+    std::unordered_map<uint32_t, RadixNode*>::iterator it = _roots.find(pid);
+    if (it == _roots.end())
+    {
+        return NULL;
+    }
+    _last_pid = pid;
+    _last_root = it->second;
+    return _last_root;
+}
+
+int RadixPageMap::index(int page_number, int level)
+{
+    return ((uint32_t)page_number >> _shift[level]) & ((1u << _bits[level]) - 1);
+}
+
+int RadixPageMap::get(uint32_t pid, int page_number)
+{
+    _walks++;
+    RadixNode *node = root(pid);
+    if (node == NULL || page_number < 0)
+    {
+        return -1;
+    }
+    int level;
+    for (level = 0; level < _levels - 1; level++)
+    {
+        _levels_walked++;
+        node = node->children[index(page_number, level)];
+        if (node == NULL)
+        {
+            return -1;
+        }
+    }
+    _levels_walked++;
+    return node->frames[index(page_number, level)];
+}
+
+void RadixPageMap::set(uint32_t pid, int page_number, int frame)
+{
+    RadixNode *node = root(pid);
+    if (node == NULL)
+    {
+        node = newNode(0);
+        _roots[pid] = node;
+        _last_pid = pid;
+        _last_root = node;
+    }
+    int level;
+    for (level = 0; level < _levels - 1; level++)
+    {
+        RadixNode *&child = node->children[index(page_number, level)];
+        if (child == NULL)
+        {
+            child = newNode(level + 1);
+            node->used++;
+        }
+        node = child;
+    }
+    int &slot = node->frames[index(page_number, level)];
+    if (slot < 0)
+    {
+        node->used++;
+    }
+    slot = frame;
+}
+
+int RadixPageMap::erase(uint32_t pid, int page_number)
+{
+    RadixNode *path[4];
+    RadixNode *node = root(pid);
+    if (node == NULL || page_number < 0)
+    {
+        return -1;
+    }
+    int level;
+    for (level = 0; level < _levels - 1; level++)
+    {
+        path[level] = node;
+        node = node->children[index(page_number, level)];
+        if (node == NULL)
+        {
+            return -1;
+        }
+    }
+    path[level] = node;
+
+    int &slot = node->frames[index(page_number, level)];
+    int frame = slot;
+    if (frame < 0)
+    {
+        return -1;
+    }
+    slot = -1;
+    node->used--;
+
+    // Free levels that became empty, bottom up
+    while (level >= 0 && path[level]->used == 0)
+    {
+        deleteNode(path[level], level, NULL);
+        if (level > 0)
+        {
+            path[level - 1]->children[index(page_number, level - 1)] = NULL;
+            path[level - 1]->used--;
+        }
+        else
+        {
+            _roots.erase(pid);
+            if (_last_pid == pid)
+            {
+                _last_root = NULL;
+            }
+        }
+        level--;
+    }
+    return frame;
+}
+
+void RadixPageMap::eraseProcess(uint32_t pid, std::vector<int> &frames)
+{
+    std::unordered_map<uint32_t, RadixNode*>::iterator it = _roots.find(pid);
+    if (it == _roots.end())
+    {
+        return;
+    }
+    deleteNode(it->second, 0, &frames);
+    if (_last_pid == pid)
+    {
+        _last_root = NULL;
+    }
+    _roots.erase(it);
+}
+
+void RadixPageMap::collect(RadixNode *node, int level, uint32_t pid, int page_prefix, std::vector<PageMapEntry> &out)
+{
+    int i;
+    if (level == _levels - 1)
+    {
+        for (i = 0; i < node->frames.size(); i++)
+        {
+            if (node->frames[i] >= 0)
+            {
+                PageMapEntry entry = {pid, page_prefix | (i << _shift[level]), node->frames[i]};
+                out.push_back(entry);
+            }
+        }
+        return;
+    }
+    for (i = 0; i < node->children.size(); i++)
+    {
+        if (node->children[i] != NULL)
+        {
+            collect(node->children[i], level + 1, pid, page_prefix | (i << _shift[level]), out);
+        }
+    }
+}
+
+void RadixPageMap::entries(std::vector<PageMapEntry> &out)
+{
+    std::unordered_map<uint32_t, RadixNode*>::iterator it;
+    for (it = _roots.begin(); it != _roots.end(); it++)
+    {
+        collect(it->second, 0, it->first, 0, out);
+    }
+}
+
+size_t RadixPageMap::footprint()
+{
+    return _bytes + _roots.size() * (sizeof(uint32_t) + sizeof(RadixNode*));
+}
+
+int RadixPageMap::levels()
+{
+    return _levels;
+}
+
+//
+// ConcurrentPageMap
+//
+
+ConcurrentPageMap::ConcurrentPageMap(int page_bits, int levels)
+{
+    if (levels < 2)
+    {
+        levels = 2;
+    }
+    if (levels > 4)
+    {
+        levels = 4;
+    }
+    _levels = levels;
+    _bytes = 0;
+    _roots.store(new ConcurrentRoots());
+    memset(_counters, 0, sizeof(_counters));
+    splitPageNumber(page_bits, _levels, _bits, _shift);
+}
+
+ConcurrentPageMap::~ConcurrentPageMap()
+{
+    ConcurrentRoots *roots = _roots.load();
+    ConcurrentRoots::iterator it;
+    for (it = roots->begin(); it != roots->end(); it++)
+    {
+        deleteNode(it->second, NULL);
+    }
+    delete roots;
+}
+
+ConcurrentNode* ConcurrentPageMap::newNode(int level)
+{
+    ConcurrentNode *node = new ConcurrentNode();
+    node->level = level;
+    node->used = 0;
+    node->children = NULL;
+    node->frames = NULL;
+    size_t slots = (size_t)1 << _bits[level];
+    size_t i;
+    if (level == _levels - 1)
+    {
+        node->frames = new std::atomic<int>[slots];
+        for (i = 0; i < slots; i++)
+        {
+            node->frames[i].store(-1, std::memory_order_relaxed);
+        }
+        _bytes += sizeof(ConcurrentNode) + slots * sizeof(int);
+    }
+    else
+    {
+        node->children = new std::atomic<ConcurrentNode*>[slots];
+        for (i = 0; i < slots; i++)
+        {
+            node->children[i].store(NULL, std::memory_order_relaxed);
+        }
+        _bytes += sizeof(ConcurrentNode) + slots * sizeof(ConcurrentNode*);
+    }
+    return node;
+}
+
+// Deletes a node and everything below it, appending mapped frames to `frames` if given
+void ConcurrentPageMap::deleteNode(ConcurrentNode *node, std::vector<int> *frames)
+{
+    size_t slots = (size_t)1 << _bits[node->level];
+    size_t i;
+    if (node->level == _levels - 1)
+    {
+        for (i = 0; frames != NULL && i < slots; i++)
+        {
+            int frame = node->frames[i].load(std::memory_order_relaxed);
+            if (frame >= 0)
+            {
+                frames->push_back(frame);
+            }
+        }
+        delete[] node->frames;
+        _bytes -= sizeof(ConcurrentNode) + slots * sizeof(int);
+    }
+    else
+    {
+        for (i = 0; i < slots; i++)
+        {
+            ConcurrentNode *child = node->children[i].load(std::memory_order_relaxed);
+            if (child != NULL)
+            {
+                deleteNode(child, frames);
+            }
+        }
+        delete[] node->children;
+        _bytes -= sizeof(ConcurrentNode) + slots * sizeof(ConcurrentNode*);
+    }
+    delete node;
+}
+
+// Retired nodes are destroyed by the epoch domain, from inside a writer
+void ConcurrentPageMap::destroyNode(void *node, void *map)
+{
+    ((ConcurrentPageMap *)map)->deleteNode((ConcurrentNode *)node, NULL);
+}
+
+void ConcurrentPageMap::destroyRoots(void *roots, void *map)
+{
+    delete (ConcurrentRoots *)roots;
+}
+
+// Replace the root table seen by lookups, the old one is freed once unused
+void ConcurrentPageMap::publishRoots(ConcurrentRoots *roots)
+{
+    ConcurrentRoots *old_roots = _roots.load();
+    _roots.store(roots, std::memory_order_release);
+    _epochs.retire(old_roots, destroyRoots, this);
+}
+
+int ConcurrentPageMap::index(int page_number, int level)
+{
+    return ((uint32_t)page_number >> _shift[level]) & ((1u << _bits[level]) - 1);
+}
+
+int ConcurrentPageMap::get(uint32_t pid, int page_number)
+{
+    EpochGuard guard(&_epochs);
+    ConcurrentCounters &counters = _counters[guard.slot()];
+    counters.walks++;
+    const ConcurrentRoots *roots = _roots.load(std::memory_order_acquire);
+    ConcurrentRoots::const_iterator it = roots->find(pid);
+    if (it == roots->end() || page_number < 0)
+    {
+        return -1;
+    }
+    ConcurrentNode *node = it->second;
+    int level;
+    for (level = 0; level < _levels - 1; level++)
+    {
+        counters.levels_walked++;
+        node = node->children[index(page_number, level)].load(std::memory_order_acquire);
+        if (node == NULL)
+        {
+            return -1;
+        }
+    }
+    counters.levels_walked++;
+    return node->frames[index(page_number, level)].load(std::memory_order_acquire);
+}
+
+void ConcurrentPageMap::set(uint32_t pid, int page_number, int frame)
+{
+    std::lock_guard<std::mutex> guard(_write_lock);
+    ConcurrentRoots *roots = _roots.load();
+    ConcurrentRoots::iterator it = roots->find(pid);
+    ConcurrentNode *node;
+    if (it != roots->end())
+    {
+        node = it->second;
+    }
+    else
+    {
+        node = newNode(0);
+        ConcurrentRoots *new_roots = new ConcurrentRoots(*roots);
+        (*new_roots)[pid] = node;
+        publishRoots(new_roots);
+    }
+    int level;
+    for (level = 0; level < _levels - 1; level++)
+    {
+        std::atomic<ConcurrentNode*> &child = node->children[index(page_number, level)];
+        ConcurrentNode *next = child.load(std::memory_order_relaxed);
+        if (next == NULL)
+        {
+            // Fully built before lookups can see it
+            next = newNode(level + 1);
+            child.store(next, std::memory_order_release);
+            node->used++;
+        }
+        node = next;
+    }
+    std::atomic<int> &slot = node->frames[index(page_number, level)];
+    if (slot.load(std::memory_order_relaxed) < 0)
+    {
+        node->used++;
+    }
+    slot.store(frame, std::memory_order_release);
+}
+
+int ConcurrentPageMap::erase(uint32_t pid, int page_number)
+{
+    std::lock_guard<std::mutex> guard(_write_lock);
+    ConcurrentRoots *roots = _roots.load();
+    ConcurrentRoots::iterator it = roots->find(pid);
+    if (it == roots->end() || page_number < 0)
+    {
+        return -1;
+    }
+    ConcurrentNode *path[4];
+    ConcurrentNode *node = it->second;
+    int level;
+    for (level = 0; level < _levels - 1; level++)
+    {
+        path[level] = node;
+        node = node->children[index(page_number, level)].load(std::memory_order_relaxed);
+        if (node == NULL)
+        {
+            return -1;
+        }
+    }
+    path[level] = node;
+
+    int frame = node->frames[index(page_number, level)].exchange(-1);
+    if (frame < 0)
+    {
+        return -1;
+    }
+    node->used--;
+
+    // Unlink levels that became empty, bottom up, and free them once no lookup is inside
+    while (level >= 0 && path[level]->used == 0)
+    {
+        if (level > 0)
+        {
+            path[level - 1]->children[index(page_number, level - 1)].store(NULL, std::memory_order_release);
+            path[level - 1]->used--;
+        }
+        else
+        {
+            ConcurrentRoots *new_roots = new ConcurrentRoots(*roots);
+            new_roots->erase(pid);
+            publishRoots(new_roots);
+        }
+        _epochs.retire(path[level], destroyNode, this);
+        level--;
+    }
+    return frame;
+}
+
+void ConcurrentPageMap::eraseProcess(uint32_t pid, std::vector<int> &frames)
+{
+    std::lock_guard<std::mutex> guard(_write_lock);
+    ConcurrentRoots *roots = _roots.load();
+    ConcurrentRoots::iterator it = roots->find(pid);
+    if (it == roots->end())
+    {
+        return;
+    }
+    ConcurrentNode *root = it->second;
+    ConcurrentRoots *new_roots = new ConcurrentRoots(*roots);
+    new_roots->erase(pid);
+    publishRoots(new_roots);
+    // Lookups that found the old root may still walk the tree, so only its
+    // frames are collected now
+    std::vector<PageMapEntry> entries;
+    collect(root, pid, 0, entries);
+    int i;
+    for (i = 0; i < entries.size(); i++)
+    {
+        frames.push_back(entries[i].frame);
+    }
+    _epochs.retire(root, destroyNode, this);
+}
+
+void ConcurrentPageMap::collect(ConcurrentNode *node, uint32_t pid, int page_prefix, std::vector<PageMapEntry> &out)
+{
+    size_t slots = (size_t)1 << _bits[node->level];
+    int i;
+    if (node->level == _levels - 1)
+    {
+        for (i = 0; i < slots; i++)
+        {
+            int frame = node->frames[i].load(std::memory_order_relaxed);
+            if (frame >= 0)
+            {
+                PageMapEntry entry = {pid, page_prefix | (i << _shift[node->level]), frame};
+                out.push_back(entry);
+            }
+        }
+        return;
+    }
+    for (i = 0; i < slots; i++)
+    {
+        ConcurrentNode *child = node->children[i].load(std::memory_order_relaxed);
+        if (child != NULL)
+        {
+            collect(child, pid, page_prefix | (i << _shift[node->level]), out);
+        }
+    }
+}
+
+void ConcurrentPageMap::entries(std::vector<PageMapEntry> &out)
+{
+    std::lock_guard<std::mutex> guard(_write_lock);
+    ConcurrentRoots *roots = _roots.load();
+    ConcurrentRoots::iterator it;
+    for (it = roots->begin(); it != roots->end(); it++)
+    {
+        collect(it->second, it->first, 0, out);
+    }
+}
+
+size_t ConcurrentPageMap::footprint()
+{
+    std::lock_guard<std::mutex> guard(_write_lock);
+    return _bytes + _roots.load()->size() * (sizeof(uint32_t) + sizeof(ConcurrentNode*));
+}
+
+int ConcurrentPageMap::levels()
+{
+    return _levels;
+}
+
+uint64_t ConcurrentPageMap::walks()
+{
+    uint64_t total = 0;
+    int i;
+    for (i = 0; i < EPOCH_SLOTS; i++)
+    {
+        total += _counters[i].walks;
+    }
+    return total;
+}
+
+uint64_t ConcurrentPageMap::levelsWalked()
+{
+    uint64_t total = 0;
+    int i;
+    for (i = 0; i < EPOCH_SLOTS; i++)
+    {
+        total += _counters[i].levels_walked;
+    }
+    return total;
+}
@@ -1,155 +1,1312 @@
 #include "pagetable.h"
+#include "image.h"
 #include <cmath>
+#include <cstring>
+#include <unistd.h>
 
-PageTable::PageTable(int page_size)
+PageTable::PageTable(int page_size, PageTableMode mode, int levels)
 {
     _page_size = page_size;
+    _page_bits = (int)log2(page_size); // number of bits for page offset
+    _concurrent = mode == PageTableMode::Concurrent;
+    if (mode == PageTableMode::Radix)
+    {
+        _map = new RadixPageMap(_page_bits, levels);
+    }
+    else if (mode == PageTableMode::Concurrent)
+    {
+        _map = new ConcurrentPageMap(_page_bits, levels);
+    }
+    else
+    {
+        _map = new FlatPageMap();
+    }
+    _frames = new FrameAllocator();
+    _tlb = NULL;
+    _replacer = NULL;
+    _replacement_policy = ReplacementPolicy::Clock;
+    _memory = NULL;
+    _frame_limit = 0;
+    _frames_held = 0;
+    _swap = NULL;
+    _swap_slots = new FrameAllocator();
+    _shared_memory = false;
+    _zero_frame = -1;
+    _paging.faults = 0;
+    _paging.evictions = 0;
+    _paging.zero_fills = 0;
+    _paging.cow_copies = 0;
+    _huge_pages = false;
+    _huge_mappings[0] = 0;
+    _huge_mappings[1] = 0;
+    _last_image = 0;
+}
+
+// Page size level of a large (1) or huge (2) page key, and its shift in base pages
+static int pageShift(int level)
+{
+    return level == 2 ? HUGE_PAGE_SHIFT : LARGE_PAGE_SHIFT;
+}
+
+// Large and huge pages are keyed by their number in their own page size,
+// tagged with the level so they never collide with base page numbers in the TLB
+static int pageKey(int level, int page_number)
+{
+    return (level << 29) | (page_number >> pageShift(level));
 }
 
 PageTable::~PageTable()
 {
+    delete _map;
+    delete _tlb;
+    delete _replacer;
+    if (!_shared_memory)
+    {
+        delete _frames;
+        delete _swap_slots;
+        if (_swap != NULL)
+        {
+            fclose(_swap);
+        }
+    }
+}
+
+// Cache translations in a TLB of `entries` entries, 0 disables it. Not
+// available in concurrent mode
+void PageTable::enableTlb(int entries, int ways, TlbPolicy policy)
+{
+    delete _tlb;
+    _tlb = NULL;
+    if (entries > 0 && !_concurrent)
+    {
+        _tlb = new Tlb(entries, ways, policy);
+    }
 }
 
-std::vector<std::string> PageTable::sortedKeys()
+// Limit physical memory to `frames` frames of `memory`. The last frame is
+// kept zeroed and shared by every page that hasn't been written yet, pages
+// get a frame of their own on first write, and frames shared by fork are
+// copied on write. Once all frames are in use, pages picked by the
+// replacement policy are written to a swap file (a temporary file unless
+// `swap_path` is given) and read back on their next translation. Returns
+// false if the swap file can't be created, or in concurrent mode.
+bool PageTable::enablePaging(void *memory, int frames, ReplacementPolicy policy, const char *swap_path)
 {
-    std::vector<std::string> keys;
+    if (_concurrent)
+    {
+        return false;
+    }
+    _swap = swap_path != NULL ? fopen(swap_path, "w+b") : tmpfile();
+    if (_swap == NULL)
+    {
+        return false;
+    }
+    _memory = (uint8_t *)memory;
+    _frame_limit = frames;
+    _replacement_policy = policy;
+    _replacer = createPageReplacer(policy, frames);
+    _frame_owners.resize(frames);
+    _dirty.assign((frames + 63) / 64, 0);
+    _zero_frame = frames - 1;
+    _frames->reserve(_zero_frame);
+    _frames_held = 1;
+    memset(_memory + (size_t)_zero_frame * _page_size, 0, _page_size);
+    return true;
+}
+
+// Back pages with the first `frames` frames of `memory` without paging, as
+// in concurrent mode: every mapped page takes a frame of its own, and pages
+// beyond the last frame aren't mapped at all
+void PageTable::useMemory(void *memory, int frames)
+{
+    _memory = (uint8_t *)memory;
+    _frame_limit = frames;
+}
+
+// Evict pages once this page table holds `frame_limit` frames (counting the
+// zero frame) rather than once physical memory is full, so that shards
+// sharing physical memory each get a part of it
+void PageTable::limitFrames(int frame_limit)
+{
+    _frame_limit = frame_limit;
+}
+
+// Make this page table a shard of `owner` (which has paging enabled): it
+// keeps translations, TLB and replacement state of its own but allocates
+// frames and swap slots from the owner's allocators, within the owner's
+// frame limit. Shards must only run processes of their own, since frames
+// are only shared copy-on-write between the processes of one page table.
+void PageTable::shareMemory(PageTable *owner)
+{
+    delete _frames;
+    delete _swap_slots;
+    delete _replacer;
+    _shared_memory = true;
+    _frames = owner->_frames;
+    _swap_slots = owner->_swap_slots;
+    _swap = owner->_swap;
+    _memory = owner->_memory;
+    _frame_limit = owner->_frame_limit;
+    _frames_held = 1;
+    _zero_frame = owner->_zero_frame;
+    _replacement_policy = owner->_replacement_policy;
+    _replacer = createPageReplacer(_replacement_policy, owner->_frame_owners.size());
+    _frame_owners.resize(owner->_frame_owners.size());
+}
+
+// Map runs of contiguous frames as large and huge pages where addRange()
+// covers a whole aligned one
+void PageTable::enableHugePages()
+{
+    _huge_pages = !_concurrent;
+}
+
+// Returns the frame backing a page through a large or huge mapping, setting
+// `key` to the mapping's key, or -1 if no such mapping covers the page
+int PageTable::hugeFrame(uint32_t pid, int page_number, int *key)
+{
+    if (_huge_mappings[0] + _huge_mappings[1] == 0)
+    {
+        return -1;
+    }
+    std::unordered_map<uint32_t, std::unordered_map<int, int> >::iterator process = _huge_map.find(pid);
+    if (process == _huge_map.end())
+    {
+        return -1;
+    }
+    int level;
+    for (level = 2; level >= 1; level--)
+    {
+        std::unordered_map<int, int>::iterator it = process->second.find(pageKey(level, page_number));
+        if (it != process->second.end())
+        {
+            *key = it->first;
+            return it->second + (page_number & ((1 << pageShift(level)) - 1));
+        }
+    }
+    return -1;
+}
+
+// Turn a large or huge mapping back into base pages on the same frames
+void PageTable::splitHugePage(uint32_t pid, int key)
+{
+    std::unordered_map<int, int> &pages = _huge_map[pid];
+    int first_frame = pages[key];
+    pages.erase(key);
+    if (pages.empty())
+    {
+        _huge_map.erase(pid);
+    }
+    int level = key >> 29;
+    int count = 1 << pageShift(level);
+    int first_page = (key & ((1 << 29) - 1)) << pageShift(level);
+    _huge_mappings[level - 1]--;
+    if (_tlb != NULL)
+    {
+        _tlb->invalidate(pid, key);
+    }
+    int i;
+    for (i = 0; i < count; i++)
+    {
+        mapFrame(pid, first_page + i, first_frame + i);
+    }
+}
 
-    std::map<std::string, int>::iterator it;
-    for (it = _table.begin(); it != _table.end(); it++)
+void PageTable::splitProcessHugePages(uint32_t pid)
+{
+    std::unordered_map<uint32_t, std::unordered_map<int, int> >::iterator process = _huge_map.find(pid);
+    if (process == _huge_map.end())
+    {
+        return;
+    }
+    std::vector<int> keys;
+    std::unordered_map<int, int>::iterator it;
+    for (it = process->second.begin(); it != process->second.end(); it++)
     {
         keys.push_back(it->first);
     }
+    int i;
+    for (i = 0; i < keys.size(); i++)
+    {
+        splitHugePage(pid, keys[i]);
+    }
+}
 
-    std::sort(keys.begin(), keys.end(), PageTableKeyComparator());
+// Lowest free frame, evicting a page first if all frames are in use
+// Returns -1 if every frame is in use and none can be evicted
+int PageTable::allocateFrame()
+{
+    if (_replacer != NULL && _frames_held >= _frame_limit)
+    {
+        return evict();
+    }
+    _frames_held++;
+    return _frames->allocate();
+}
 
-    return keys;
+void PageTable::mapFrame(uint32_t pid, int page_number, int frame)
+{
+    _map->set(pid, page_number, frame);
+    if (_replacer != NULL && frame != _zero_frame)
+    {
+        markDirty(frame);
+        PageMapEntry owner = {pid, page_number, frame};
+        _frame_owners[frame].push_back(owner);
+        if (_frame_owners[frame].size() == 1)
+        {
+            _replacer->insert(frame);
+        }
+    }
+}
+
+// Drop the page of `pid` from the owners of a frame (already unmapped),
+// freeing the frame once no page maps it. With `released` set, the frame is
+// added to it for the caller to free in bulk instead
+void PageTable::unmapFrame(uint32_t pid, int frame, std::vector<int> *released)
+{
+    if (_replacer == NULL)
+    {
+        if (released != NULL)
+        {
+            released->push_back(frame);
+        }
+        else
+        {
+            _frames->free(frame);
+        }
+        _frames_held--;
+        return;
+    }
+    if (frame == _zero_frame)
+    {
+        return;
+    }
+    std::vector<PageMapEntry> &owners = _frame_owners[frame];
+    int i;
+    for (i = 0; i < owners.size(); i++)
+    {
+        if (owners[i].pid == pid)
+        {
+            owners[i] = owners.back();
+            owners.pop_back();
+            break;
+        }
+    }
+    if (owners.empty())
+    {
+        _replacer->remove(frame);
+        if (released != NULL)
+        {
+            released->push_back(frame);
+        }
+        else
+        {
+            _frames->free(frame);
+        }
+        _frames_held--;
+    }
+}
+
+// Write the frame chosen by the replacement policy out to swap and unmap
+// every page sharing it, returns the now unused (but still allocated) frame
+// or -1 if there is no frame the policy can evict
+int PageTable::evict()
+{
+    int frame = _replacer->victim();
+    if (frame < 0 && !_huge_map.empty())
+    {
+        // Every resident frame is in a large or huge page, split one up
+        std::unordered_map<uint32_t, std::unordered_map<int, int> >::iterator process = _huge_map.begin();
+        splitHugePage(process->first, process->second.begin()->first);
+        frame = _replacer->victim();
+    }
+    if (frame < 0)
+    {
+        return -1;
+    }
+    int slot = _swap_slots->allocate();
+    if (pwrite(fileno(_swap), _memory + (size_t)frame * _page_size, _page_size, (off_t)slot * _page_size) != _page_size)
+    {
+        fprintf(stderr, "error: can't write to swap file\n");
+    }
+    if (slot >= _slot_refs.size())
+    {
+        _slot_refs.resize(slot + 1, 0);
+    }
+    markSlotDirty(slot);
+    std::vector<PageMapEntry> &owners = _frame_owners[frame];
+    _slot_refs[slot] = owners.size();
+    int i;
+    for (i = 0; i < owners.size(); i++)
+    {
+        _map->erase(owners[i].pid, owners[i].page_number);
+        if (_tlb != NULL)
+        {
+            _tlb->invalidate(owners[i].pid, owners[i].page_number);
+        }
+        _swapped[owners[i].pid][owners[i].page_number] = slot;
+        _process_paging[owners[i].pid].evictions++;
+    }
+    owners.clear();
+    _paging.evictions++;
+    return frame;
+}
+
+// Drop one page's reference to a swap slot
+void PageTable::releaseSlot(int slot)
+{
+    _slot_refs[slot]--;
+    if (_slot_refs[slot] == 0)
+    {
+        _swap_slots->free(slot);
+    }
+}
+
+// Read a swapped out page back into a frame of its own, returns the frame
+// or -1 if the page isn't swapped out or no frame can be freed for it
+int PageTable::pageIn(uint32_t pid, int page_number)
+{
+    std::unordered_map<uint32_t, std::unordered_map<int, int> >::iterator process = _swapped.find(pid);
+    if (process == _swapped.end() || process->second.count(page_number) == 0)
+    {
+        return -1;
+    }
+    int frame = allocateFrame();
+    if (frame < 0)
+    {
+        fprintf(stderr, "error: out of memory\n");
+        return -1;
+    }
+    // Evicting may have swapped out other pages, so look the page up again
+    process = _swapped.find(pid);
+    std::unordered_map<int, int>::iterator page = process->second.find(page_number);
+    int slot = page->second;
+    process->second.erase(page);
+    if (process->second.empty())
+    {
+        _swapped.erase(process);
+    }
+
+    if (pread(fileno(_swap), _memory + (size_t)frame * _page_size, _page_size, (off_t)slot * _page_size) != _page_size)
+    {
+        fprintf(stderr, "error: can't read from swap file\n");
+    }
+    releaseSlot(slot);
+    mapFrame(pid, page_number, frame);
+    _paging.faults++;
+    _process_paging[pid].faults++;
+    return frame;
+}
+
+// Give a page that is written for the first time, or whose frame is shared
+// with another process, a private copy of its contents. Returns the copy,
+// or -1 if no frame can be freed for it
+int PageTable::copyOnWrite(uint32_t pid, int page_number, int frame)
+{
+    bool shared = frame != _zero_frame;
+    // Keep the source frame from being evicted while a frame for the copy is found
+    if (shared)
+    {
+        _replacer->remove(frame);
+    }
+    int copy = allocateFrame();
+    if (copy < 0)
+    {
+        if (shared)
+        {
+            _replacer->insert(frame);
+        }
+        fprintf(stderr, "error: out of memory\n");
+        return -1;
+    }
+    uint8_t *destination = _memory + (size_t)copy * _page_size;
+    if (shared)
+    {
+        memcpy(destination, _memory + (size_t)frame * _page_size, _page_size);
+        _replacer->insert(frame);
+        _paging.cow_copies++;
+        _process_paging[pid].cow_copies++;
+    }
+    else
+    {
+        memset(destination, 0, _page_size);
+        _paging.zero_fills++;
+        _process_paging[pid].zero_fills++;
+    }
+    unmapFrame(pid, frame);
+    if (_tlb != NULL)
+    {
+        _tlb->invalidate(pid, page_number);
+    }
+    mapFrame(pid, page_number, copy);
+    return copy;
 }
 
 // Frees all pages associated with given process
 void PageTable::freeProcessPages(uint32_t pid)
 {
-    std::map<std::string, int>::iterator it;
-    std::string entry;
+    std::unique_lock<std::mutex> guard(_write_lock, std::defer_lock);
+    if (_concurrent)
+    {
+        guard.lock();
+    }
+    // The frames the process mapped, and of those the ones no other process
+    // shares, which go back to the frame allocator in one call
+    std::vector<int> frames;
+    std::vector<int> released;
+    _map->eraseProcess(pid, frames);
+    if (_tlb != NULL)
+    {
+        _tlb->invalidateProcess(pid);
+    }
     int i;
-    int size = _table.size();
-    for (i=0; i < size; i++)
+    for (i = 0; i < frames.size(); i++)
     {
-        entry = std::to_string(pid) + "|" + std::to_string(i);
-        it = _table.find(entry);
-        if (it == _table.end())
+        unmapFrame(pid, frames[i], &released);
+    }
+    std::unordered_map<uint32_t, std::unordered_map<int, int> >::iterator huge = _huge_map.find(pid);
+    if (huge != _huge_map.end())
+    {
+        std::unordered_map<int, int>::iterator it;
+        for (it = huge->second.begin(); it != huge->second.end(); it++)
         {
-            break;
+            int level = it->first >> 29;
+            int count = 1 << pageShift(level);
+            for (i = 0; i < count; i++)
+            {
+                released.push_back(it->second + i);
+            }
+            _frames_held -= count;
+            _huge_mappings[level - 1]--;
+        }
+        _huge_map.erase(huge);
+    }
+    _frames->freeFrames(released);
+    if (_replacer != NULL)
+    {
+        std::unordered_map<uint32_t, std::unordered_map<int, int> >::iterator process = _swapped.find(pid);
+        if (process != _swapped.end())
+        {
+            std::unordered_map<int, int>::iterator page;
+            for (page = process->second.begin(); page != process->second.end(); page++)
+            {
+                releaseSlot(page->second);
+            }
+            _swapped.erase(process);
         }
-        _table.erase(it);
+        _process_paging.erase(pid);
     }
 }
 
 // Free a frame in the page table
 void PageTable::freeFrame(uint32_t pid, int page_number)
 {
-    // Combination of pid and page number act as the key to look up frame number
-    std::string entry = std::to_string(pid) + "|" + std::to_string(page_number);
-    // Free frame
-    _table.erase(entry);
+    std::unique_lock<std::mutex> guard(_write_lock, std::defer_lock);
+    if (_concurrent)
+    {
+        guard.lock();
+    }
+    int key;
+    if (hugeFrame(pid, page_number, &key) >= 0)
+    {
+        splitHugePage(pid, key);
+    }
+    int frame = _map->erase(pid, page_number);
+    if (_tlb != NULL)
+    {
+        _tlb->invalidate(pid, page_number);
+    }
+    if (frame >= 0)
+    {
+        unmapFrame(pid, frame);
+    }
+    else if (_replacer != NULL)
+    {
+        std::unordered_map<uint32_t, std::unordered_map<int, int> >::iterator process = _swapped.find(pid);
+        if (process != _swapped.end() && process->second.count(page_number) > 0)
+        {
+            releaseSlot(process->second[page_number]);
+            process->second.erase(page_number);
+            if (process->second.empty())
+            {
+                _swapped.erase(process);
+            }
+        }
+    }
 }
 
 // Get a specified frame in the page table
 int PageTable::getFrame(uint32_t pid, int page_number)
 {
-    // Combination of pid and page number act as the key to look up frame number
-    std::string entry = std::to_string(pid) + "|" + std::to_string(page_number);
-    std::map<std::string, int>::iterator it = _table.find(entry);
+    int frame = _map->get(pid, page_number);
+    int key;
+    if (frame < 0)
+    {
+        frame = hugeFrame(pid, page_number, &key);
+    }
+    if (frame < 0 && _replacer != NULL)
+    {
+        std::unordered_map<uint32_t, std::unordered_map<int, int> >::iterator process = _swapped.find(pid);
+        if (process != _swapped.end() && process->second.count(page_number) > 0)
+        {
+            return -2;
+        }
+    }
+    return frame;
+}
 
-    if (it == _table.end())
+bool PageTable::ownsFrame(uint32_t pid, int page_number)
+{
+    int frame = getFrame(pid, page_number);
+    if (frame < 0)
     {
-        return -1;
+        return false;
     }
-    else
+    if (_replacer == NULL)
+    {
+        return true;
+    }
+    if (frame == _zero_frame)
     {
-        return _table[entry];
+        return false;
     }
-    
+    // Large and huge pages are never shared
+    return _map->get(pid, page_number) < 0 || _frame_owners[frame].size() == 1;
+}
+
+bool PageTable::zeroPage(uint32_t pid, int page_number)
+{
+    int frame = getFrame(pid, page_number);
+    return frame == -1 || (_replacer != NULL && frame == _zero_frame);
 }
 
+// Map a page. With paging enabled it is backed by the zero frame until its first write
 void PageTable::addEntry(uint32_t pid, int page_number)
-{   
-    
-    // Combination of pid and page number act as the key to look up frame number
-    std::string entry = std::to_string(pid) + "|" + std::to_string(page_number);
-
-    // Find free frame
-    // TODO: implement this!
-    std::vector<std::string> keys = sortedKeys();
-    int frame = 0;
-    int current_frame = 0;
-    
-    while (1)
-    {   
-        bool isFree = true;
-        int i; // loop through page table
-        for (i = 0; i < keys.size(); i++)
-        {
-            // if `frame` is used by another frame, test next lowest frame number
-            current_frame = _table[keys[i]];
-            if (frame == current_frame)
+{
+    std::unique_lock<std::mutex> guard(_write_lock, std::defer_lock);
+    if (_concurrent)
+    {
+        guard.lock();
+    }
+    if (_replacer != NULL)
+    {
+        mapFrame(pid, page_number, _zero_frame);
+        return;
+    }
+    if (_frame_limit > 0 && _frames_held >= _frame_limit)
+    {
+        fprintf(stderr, "error: out of memory\n");
+        return;
+    }
+    int frame = _frames->allocate();
+    _frames_held++;
+    if (_memory != NULL)
+    {
+        memset(_memory + (size_t)frame * _page_size, 0, _page_size);
+    }
+    _map->set(pid, page_number, frame);
+}
+
+// Map pages first_page to last_page that aren't mapped yet, using large
+// and huge pages for every aligned run of them that is entirely unmapped
+// and for which contiguous frames are free
+void PageTable::addRange(uint32_t pid, int first_page, int last_page)
+{
+    int page = first_page;
+    while (page <= last_page)
+    {
+        int mapped = 0; // base pages covered by a new large or huge page
+        int level;
+        for (level = 2; _huge_pages && level >= 1 && mapped == 0; level--)
+        {
+            int count = 1 << pageShift(level);
+            if (page % count != 0 || page + count - 1 > last_page)
+            {
+                continue;
+            }
+            int i;
+            for (i = 0; i < count && getFrame(pid, page + i) == -1; i++)
+            {
+            }
+            if (i < count)
+            {
+                continue;
+            }
+            // Leave a couple of frames for base pages and copy-on-write
+            if (_replacer != NULL && _frames_held + count > _frame_limit - 2)
+            {
+                continue;
+            }
+            int limit = _replacer != NULL ? _zero_frame - 1 : 0x7fffffff;
+            int first_frame = _frames->allocateRun(count, limit);
+            if (first_frame < 0)
             {
-                isFree = false;
-                frame++;
-                break;
+                continue;
             }
+            _frames_held += count;
+            if (_memory != NULL)
+            {
+                memset(_memory + (size_t)first_frame * _page_size, 0, (size_t)count * _page_size);
+            }
+            int f;
+            for (f = 0; f < count; f++)
+            {
+                markDirty(first_frame + f);
+            }
+            _huge_map[pid][pageKey(level, page)] = first_frame;
+            _huge_mappings[level - 1]++;
+            mapped = count;
         }
-        if (isFree)
+        if (mapped > 0)
         {
-            _table[entry] = frame;
-            break;
+            page += mapped;
+            continue;
+        }
+        if (getFrame(pid, page) == -1)
+        {
+            addEntry(pid, page);
         }
-    }    
+        page++;
+    }
 }
 
-int PageTable::getPhysicalAddress(uint32_t pid, uint32_t virtual_address)
+// Map every page of the parent into the child, sharing frames and swap
+// slots copy-on-write. Without paging the child gets a copy of each page
+// instead. Returns false, mapping nothing, if there is no memory to copy
+// the pages into or not enough of it.
+bool PageTable::forkPages(uint32_t parent_pid, uint32_t child_pid)
 {
-    // Convert virtual address to page_number and page_offset
-    // TODO: implement this!
-    int page_number = 0;
-    int page_offset = 0;
+    if (_replacer == NULL)
+    {
+        return copyPages(parent_pid, child_pid);
+    }
+    splitProcessHugePages(parent_pid);
+    std::vector<PageMapEntry> entries;
+    _map->entries(entries);
+    int i;
+    for (i = 0; i < entries.size(); i++)
+    {
+        if (entries[i].pid == parent_pid)
+        {
+            mapFrame(child_pid, entries[i].page_number, entries[i].frame);
+        }
+    }
+    std::unordered_map<uint32_t, std::unordered_map<int, int> >::iterator process = _swapped.find(parent_pid);
+    if (process != _swapped.end())
+    {
+        std::unordered_map<int, int> pages = process->second;
+        std::unordered_map<int, int>::iterator page;
+        for (page = pages.begin(); page != pages.end(); page++)
+        {
+            _swapped[child_pid][page->first] = page->second;
+            _slot_refs[page->second]++;
+        }
+    }
+    return true;
+}
 
-    int n = (int)log2(_page_size); // n = number of bits for page offset
-    page_number = virtual_address >> n;
-    page_offset = (_page_size - 1) & virtual_address;
+bool PageTable::copyPages(uint32_t parent_pid, uint32_t child_pid)
+{
+    std::unique_lock<std::mutex> guard(_write_lock, std::defer_lock);
+    if (_concurrent)
+    {
+        guard.lock();
+    }
+    if (_memory == NULL)
+    {
+        return false;
+    }
+    splitProcessHugePages(parent_pid);
+    std::vector<PageMapEntry> entries;
+    _map->entries(entries);
+    std::vector<PageMapEntry> pages;
+    int i;
+    for (i = 0; i < entries.size(); i++)
+    {
+        if (entries[i].pid == parent_pid)
+        {
+            pages.push_back(entries[i]);
+        }
+    }
+    if (_frame_limit > 0 && _frames_held + (int)pages.size() > _frame_limit)
+    {
+        return false;
+    }
+    for (i = 0; i < pages.size(); i++)
+    {
+        int frame = _frames->allocate();
+        _frames_held++;
+        memcpy(_memory + (size_t)frame * _page_size, _memory + (size_t)pages[i].frame * _page_size, _page_size);
+        _map->set(child_pid, pages[i].page_number, frame);
+    }
+    return true;
+}
 
-    // Combination of pid and page number act as the key to look up frame number
-    std::string entry = std::to_string(pid) + "|" + std::to_string(page_number);
+int PageTable::getPhysicalAddress(uint32_t pid, uint32_t virtual_address, bool write)
+{
+    // Convert virtual address to page_number and page_offset
+    int page_number = virtual_address >> _page_bits;
+    int page_offset = (_page_size - 1) & virtual_address;
 
     // If entry exists, look up frame number and convert virtual to physical address
     int address = -1;
-    int frame_number = 0;
-    if (_table.count(entry) > 0)
+    int frame_number = -1;
+    bool cached = false;
+    bool huge = _huge_mappings[0] + _huge_mappings[1] > 0;
+    if (_tlb != NULL)
+    {
+        frame_number = _tlb->lookup(pid, page_number, !huge);
+        cached = frame_number >= 0;
+    }
+    if (frame_number < 0 && huge)
+    {
+        // Probe the TLB for each larger page size, then the large and huge mappings
+        int level;
+        for (level = 2; _tlb != NULL && level >= 1 && frame_number < 0; level--)
+        {
+            int first_frame = _tlb->lookup(pid, pageKey(level, page_number), level == 1);
+            if (first_frame >= 0)
+            {
+                frame_number = first_frame + (page_number & ((1 << pageShift(level)) - 1));
+            }
+        }
+        if (frame_number < 0)
+        {
+            int key;
+            frame_number = hugeFrame(pid, page_number, &key);
+            if (_tlb != NULL && frame_number >= 0)
+            {
+                int offset = page_number & ((1 << pageShift(key >> 29)) - 1);
+                _tlb->insert(pid, key, frame_number - offset);
+            }
+        }
+        cached = frame_number >= 0;
+    }
+    if (frame_number < 0)
+    {
+        frame_number = _map->get(pid, page_number);
+        if (frame_number < 0 && _replacer != NULL)
+        {
+            // Page fault
+            frame_number = pageIn(pid, page_number);
+        }
+    }
+    if (write && _replacer != NULL && frame_number >= 0 &&
+        (frame_number == _zero_frame || _frame_owners[frame_number].size() > 1))
+    {
+        // First write to an untouched page, or write to a shared one
+        frame_number = copyOnWrite(pid, page_number, frame_number);
+        cached = false;
+    }
+    if (write && frame_number >= 0)
+    {
+        markDirty(frame_number);
+    }
+    if (_tlb != NULL && !cached && frame_number >= 0)
+    {
+        _tlb->insert(pid, page_number, frame_number);
+    }
+    if (_replacer != NULL && frame_number >= 0 && frame_number != _zero_frame)
+    {
+        _replacer->access(frame_number);
+    }
+    if (frame_number >= 0)
     {
-        // TODO: implement this!
-        frame_number = _table[entry];
         address = (_page_size * frame_number) + page_offset;
     }
 
     return address;
 }
 
+static bool pageMapEntryLess(const PageMapEntry &a, const PageMapEntry &b)
+{
+    return (a.pid < b.pid || (a.pid == b.pid && a.page_number < b.page_number));
+}
+
 void PageTable::print()
 {
     int i;
 
-    std::cout << " PID  | Page Number | Frame Number" << std::endl;
-    std::cout << "------+-------------+--------------" << std::endl;
+    std::cout << " PID  | Page Number | Frame Number" << "\n";
+    std::cout << "------+-------------+--------------" << "\n";
 
-    std::vector<std::string> keys = sortedKeys();
+    std::vector<PageMapEntry> entries;
+    _map->entries(entries);
+    // Large and huge pages are listed page by page
+    std::unordered_map<uint32_t, std::unordered_map<int, int> >::iterator huge;
+    for (huge = _huge_map.begin(); huge != _huge_map.end(); huge++)
+    {
+        std::unordered_map<int, int>::iterator it;
+        for (it = huge->second.begin(); it != huge->second.end(); it++)
+        {
+            int shift = pageShift(it->first >> 29);
+            int first_page = (it->first & ((1 << 29) - 1)) << shift;
+            int p;
+            for (p = 0; p < (1 << shift); p++)
+            {
+                PageMapEntry entry = {huge->first, first_page + p, it->second + p};
+                entries.push_back(entry);
+            }
+        }
+    }
+    // Swapped out pages are listed with a frame of -1
+    std::unordered_map<uint32_t, std::unordered_map<int, int> >::iterator process;
+    for (process = _swapped.begin(); process != _swapped.end(); process++)
+    {
+        std::unordered_map<int, int>::iterator page;
+        for (page = process->second.begin(); page != process->second.end(); page++)
+        {
+            PageMapEntry entry = {process->first, page->first, -1};
+            entries.push_back(entry);
+        }
+    }
+    std::sort(entries.begin(), entries.end(), pageMapEntryLess);
 
-    for (i = 0; i < keys.size(); i++)
+    for (i = 0; i < entries.size(); i++)
+    {
+        if (entries[i].frame < 0)
+        {
+            printf(" %4u | %11d | %12s\n", entries[i].pid, entries[i].page_number, "swapped");
+            continue;
+        }
+        if (_replacer != NULL && entries[i].frame == _zero_frame)
+        {
+            printf(" %4u | %11d | %12s\n", entries[i].pid, entries[i].page_number, "zero");
+            continue;
+        }
+        printf(" %4u | %11d | %12d\n", entries[i].pid, entries[i].page_number, entries[i].frame);
+    }
+}
+
+void PageTable::printStats()
+{
+    uint64_t walks = _map->walks();
+    double levels_per_walk = walks > 0 ? (double)_map->levelsWalked() / walks : 0.0;
+
+    printf("Page table levels      : %d\n", _map->levels());
+    if (_huge_pages)
+    {
+        std::vector<PageMapEntry> entries;
+        _map->entries(entries);
+        printf("Base page entries      : %zu\n", entries.size());
+        printf("Large page entries     : %d (%d bytes each)\n", _huge_mappings[0], _page_size << LARGE_PAGE_SHIFT);
+        printf("Huge page entries      : %d (%d bytes each)\n", _huge_mappings[1], _page_size << HUGE_PAGE_SHIFT);
+    }
+    printf("Page table footprint   : %zu bytes\n", _map->footprint());
+    printf("Frames in use          : %u\n", _frames->framesInUse());
+    printf("Translations           : %llu\n", (unsigned long long)walks);
+    printf("Levels walked          : %llu (%.2f per translation)\n", (unsigned long long)_map->levelsWalked(), levels_per_walk);
+    if (_tlb != NULL)
+    {
+        uint64_t lookups = _tlb->hits() + _tlb->misses();
+        printf("TLB                    : %d entries, %d-way, %s\n", _tlb->size(), _tlb->ways(), _tlb->policy() == TlbPolicy::Random ? "random" : "LRU");
+        printf("TLB reach              : %d bytes\n", _tlb->size() * _page_size);
+        printf("TLB hits               : %llu (%.2f%%)\n", (unsigned long long)_tlb->hits(), lookups > 0 ? 100.0 * _tlb->hits() / lookups : 0.0);
+        printf("TLB misses             : %llu\n", (unsigned long long)_tlb->misses());
+    }
+    if (_replacer != NULL)
+    {
+        printf("Frame limit            : %d (%s replacement)\n", _frame_limit, replacementPolicyName(_replacement_policy));
+        int shared = 0;
+        int f;
+        for (f = 0; f < _frame_owners.size(); f++)
+        {
+            if (_frame_owners[f].size() > 1)
+            {
+                shared++;
+            }
+        }
+        printf("Shared frames          : %d\n", shared);
+        printf("Swap slots in use      : %u\n", _swap_slots->framesInUse());
+        printf("Page faults            : %llu\n", (unsigned long long)_paging.faults);
+        printf("Evictions              : %llu\n", (unsigned long long)_paging.evictions);
+        printf("Zero-fill faults       : %llu\n", (unsigned long long)_paging.zero_fills);
+        printf("Copy-on-write faults   : %llu\n", (unsigned long long)_paging.cow_copies);
+
+        std::vector<uint32_t> pids;
+        std::unordered_map<uint32_t, PagingStats>::iterator it;
+        for (it = _process_paging.begin(); it != _process_paging.end(); it++)
+        {
+            pids.push_back(it->first);
+        }
+        std::sort(pids.begin(), pids.end());
+        int i;
+        for (i = 0; i < pids.size(); i++)
+        {
+            PagingStats stats = _process_paging[pids[i]];
+            printf("  PID %-4u             : %llu faults, %llu evictions, %llu zero-fill, %llu copy-on-write\n", pids[i],
+                   (unsigned long long)stats.faults, (unsigned long long)stats.evictions,
+                   (unsigned long long)stats.zero_fills, (unsigned long long)stats.cow_copies);
+        }
+    }
+}
+
+uint32_t PageTable::framesInUse()
+{
+    return _frames->framesInUse();
+}
+
+uint32_t PageTable::countPages(std::unordered_map<uint32_t, uint32_t> &pages)
+{
+    std::vector<PageMapEntry> entries;
+    _map->entries(entries);
+    uint32_t total = entries.size();
+    int i;
+    for (i = 0; i < entries.size(); i++)
+    {
+        pages[entries[i].pid]++;
+    }
+    std::unordered_map<uint32_t, std::unordered_map<int, int> >::iterator process;
+    for (process = _huge_map.begin(); process != _huge_map.end(); process++)
+    {
+        std::unordered_map<int, int>::iterator it;
+        for (it = process->second.begin(); it != process->second.end(); it++)
+        {
+            uint32_t count = 1u << pageShift(it->first >> 29);
+            pages[process->first] += count;
+            total += count;
+        }
+    }
+    for (process = _swapped.begin(); process != _swapped.end(); process++)
+    {
+        pages[process->first] += process->second.size();
+        total += process->second.size();
+    }
+    return total;
+}
+
+PagingStats PageTable::pagingStats()
+{
+    return _paging;
+}
+
+// Paging counters of a process, all zero if it never faulted
+PagingStats PageTable::processPagingStats(uint32_t pid)
+{
+    std::unordered_map<uint32_t, PagingStats>::iterator it = _process_paging.find(pid);
+    if (it == _process_paging.end())
+    {
+        PagingStats none = {0, 0, 0, 0};
+        return none;
+    }
+    return it->second;
+}
+
+// Frame number stored for pages backed by the zero frame, which may be a
+// different frame when the image is loaded
+#define IMAGE_ZERO_FRAME -1
+
+void PageTable::markDirty(int frame)
+{
+    if (frame < (int)_dirty.size() * 64)
+    {
+        _dirty[frame >> 6] |= 1ULL << (frame & 63);
+    }
+}
+
+void PageTable::markSlotDirty(int slot)
+{
+    if (slot >= (int)_dirty_slots.size() * 64)
+    {
+        _dirty_slots.resize(slot / 64 + 1, 0);
+    }
+    _dirty_slots[slot >> 6] |= 1ULL << (slot & 63);
+}
+
+void PageTable::markClean(uint64_t image_id)
+{
+    std::fill(_dirty.begin(), _dirty.end(), 0);
+    std::fill(_dirty_slots.begin(), _dirty_slots.end(), 0);
+    _last_image = image_id;
+}
+
+uint64_t PageTable::lastImage()
+{
+    return _last_image;
+}
+
+// Every frame some page maps, other than the zero frame, in order and once
+// even if it is shared copy-on-write
+void PageTable::usedFrames(std::vector<int> &frames)
+{
+    std::vector<PageMapEntry> entries;
+    _map->entries(entries);
+    int i;
+    for (i = 0; i < entries.size(); i++)
+    {
+        if (entries[i].frame != _zero_frame)
+        {
+            frames.push_back(entries[i].frame);
+        }
+    }
+    std::unordered_map<uint32_t, std::unordered_map<int, int> >::iterator process;
+    for (process = _huge_map.begin(); process != _huge_map.end(); process++)
     {
-        // TODO: print all pages
-        size_t sep = keys[i].find("|");
-        uint32_t pid = std::stoi(keys[i].substr(0, sep));
-        int page = std::stoi(keys[i].substr(sep + 1));
-        int frame = _table[keys[i]];
+        std::unordered_map<int, int>::iterator it;
+        for (it = process->second.begin(); it != process->second.end(); it++)
+        {
+            int count = 1 << pageShift(it->first >> 29);
+            for (i = 0; i < count; i++)
+            {
+                frames.push_back(it->second + i);
+            }
+        }
+    }
+    std::sort(frames.begin(), frames.end());
+    frames.erase(std::unique(frames.begin(), frames.end()), frames.end());
+}
 
-        printf(" %4u | %11d | %12d\n", pid, page, frame);
+void PageTable::saveImage(ImageWriter &out)
+{
+    std::vector<PageMapEntry> entries;
+    _map->entries(entries);
+    std::sort(entries.begin(), entries.end(), pageMapEntryLess);
+    out.put<uint32_t>(entries.size());
+    int i;
+    for (i = 0; i < entries.size(); i++)
+    {
+        out.put<uint32_t>(entries[i].pid);
+        out.put<int32_t>(entries[i].page_number);
+        out.put<int32_t>(entries[i].frame == _zero_frame ? IMAGE_ZERO_FRAME : entries[i].frame);
+    }
+
+    out.put<uint32_t>(_huge_mappings[0] + _huge_mappings[1]);
+    std::unordered_map<uint32_t, std::unordered_map<int, int> >::iterator process;
+    for (process = _huge_map.begin(); process != _huge_map.end(); process++)
+    {
+        std::unordered_map<int, int>::iterator it;
+        for (it = process->second.begin(); it != process->second.end(); it++)
+        {
+            out.put<uint32_t>(process->first);
+            out.put<int32_t>(it->first);
+            out.put<int32_t>(it->second);
+        }
+    }
+
+    // Swapped out pages, the slots they reference are in the frame section
+    uint32_t swapped_count = 0;
+    for (process = _swapped.begin(); process != _swapped.end(); process++)
+    {
+        swapped_count += process->second.size();
+    }
+    out.put<uint32_t>(swapped_count);
+    for (process = _swapped.begin(); process != _swapped.end(); process++)
+    {
+        std::unordered_map<int, int>::iterator page;
+        for (page = process->second.begin(); page != process->second.end(); page++)
+        {
+            out.put<uint32_t>(process->first);
+            out.put<int32_t>(page->first);
+            out.put<int32_t>(page->second);
+        }
+    }
+
+    out.put(_paging);
+    out.put<uint32_t>(_process_paging.size());
+    std::unordered_map<uint32_t, PagingStats>::iterator stats;
+    for (stats = _process_paging.begin(); stats != _process_paging.end(); stats++)
+    {
+        out.put<uint32_t>(stats->first);
+        out.put(stats->second);
+    }
+}
+
+// Drop the frames or slots whose bit isn't set in `dirty`
+static void keepDirty(std::vector<int> &numbers, const std::vector<uint64_t> &dirty)
+{
+    size_t kept = 0;
+    int i;
+    for (i = 0; i < numbers.size(); i++)
+    {
+        if (numbers[i] < (int)dirty.size() * 64 && (dirty[numbers[i] >> 6] >> (numbers[i] & 63) & 1))
+        {
+            numbers[kept++] = numbers[i];
+        }
+    }
+    numbers.resize(kept);
+}
+
+void PageTable::saveFrames(ImageWriter &out, bool dirty_only)
+{
+    std::vector<int> frames;
+    usedFrames(frames);
+    std::vector<int> slots;
+    std::unordered_map<uint32_t, std::unordered_map<int, int> >::iterator process;
+    for (process = _swapped.begin(); process != _swapped.end(); process++)
+    {
+        std::unordered_map<int, int>::iterator page;
+        for (page = process->second.begin(); page != process->second.end(); page++)
+        {
+            slots.push_back(page->second);
+        }
+    }
+    std::sort(slots.begin(), slots.end());
+    slots.erase(std::unique(slots.begin(), slots.end()), slots.end());
+    if (dirty_only)
+    {
+        keepDirty(frames, _dirty);
+        keepDirty(slots, _dirty_slots);
     }
-}
\ No newline at end of file
+
+    out.put<uint32_t>(frames.size());
+    int i;
+    for (i = 0; i < frames.size(); i++)
+    {
+        out.put<int32_t>(frames[i]);
+        out.write(_memory + (size_t)frames[i] * _page_size, _page_size);
+    }
+    std::vector<uint8_t> buffer(_page_size);
+    out.put<uint32_t>(slots.size());
+    for (i = 0; i < slots.size(); i++)
+    {
+        if (pread(fileno(_swap), buffer.data(), _page_size, (off_t)slots[i] * _page_size) != _page_size)
+        {
+            fprintf(stderr, "error: can't read from swap file\n");
+        }
+        out.put<int32_t>(slots[i]);
+        out.write(buffer.data(), _page_size);
+    }
+}
+
+bool PageTable::loadImage(ImageReader &in, const std::unordered_map<int, const uint8_t *> &frames,
+                          const std::unordered_map<int, const uint8_t *> &slots)
+{
+    // Read and check everything before changing any state
+    uint32_t entry_count = in.get<uint32_t>();
+    std::vector<PageMapEntry> entries;
+    std::vector<int> used;
+    uint32_t i;
+    for (i = 0; i < entry_count && in.ok(); i++)
+    {
+        PageMapEntry entry;
+        entry.pid = in.get<uint32_t>();
+        entry.page_number = in.get<int32_t>();
+        entry.frame = in.get<int32_t>();
+        entries.push_back(entry);
+        if (entry.frame != IMAGE_ZERO_FRAME)
+        {
+            used.push_back(entry.frame);
+        }
+    }
+    uint32_t huge_count = in.get<uint32_t>();
+    std::vector<PageMapEntry> huge;
+    for (i = 0; i < huge_count && in.ok(); i++)
+    {
+        PageMapEntry entry;
+        entry.pid = in.get<uint32_t>();
+        entry.page_number = in.get<int32_t>(); // page key
+        entry.frame = in.get<int32_t>();
+        huge.push_back(entry);
+        int level = entry.page_number >> 29;
+        if (level < 1 || level > 2)
+        {
+            return false;
+        }
+        int f;
+        for (f = 0; f < 1 << pageShift(level); f++)
+        {
+            used.push_back(entry.frame + f);
+        }
+    }
+    uint32_t swapped_count = in.get<uint32_t>();
+    std::vector<PageMapEntry> swapped;
+    std::vector<int> used_slots;
+    for (i = 0; i < swapped_count && in.ok(); i++)
+    {
+        PageMapEntry entry;
+        entry.pid = in.get<uint32_t>();
+        entry.page_number = in.get<int32_t>();
+        entry.frame = in.get<int32_t>(); // swap slot
+        swapped.push_back(entry);
+        used_slots.push_back(entry.frame);
+    }
+    PagingStats paging = in.get<PagingStats>();
+    uint32_t stats_count = in.get<uint32_t>();
+    std::vector<std::pair<uint32_t, PagingStats> > process_paging;
+    for (i = 0; i < stats_count && in.ok(); i++)
+    {
+        uint32_t pid = in.get<uint32_t>();
+        process_paging.push_back(std::make_pair(pid, in.get<PagingStats>()));
+    }
+    if (!in.ok() || _memory == NULL || (_replacer == NULL && !swapped.empty()))
+    {
+        return false;
+    }
+
+    std::sort(used.begin(), used.end());
+    used.erase(std::unique(used.begin(), used.end()), used.end());
+    if (_replacer != NULL && _frames_held + (int)used.size() > _frame_limit)
+    {
+        return false;
+    }
+    // Frames must stay below the zero frame, or within memory without paging
+    int frame_end = _replacer != NULL ? _zero_frame : _frame_limit;
+    std::vector<const uint8_t *> contents;
+    for (i = 0; i < used.size(); i++)
+    {
+        std::unordered_map<int, const uint8_t *>::const_iterator source = frames.find(used[i]);
+        if (source == frames.end() || used[i] < 0 || (frame_end > 0 && used[i] >= frame_end) ||
+            _frames->isUsed(used[i]))
+        {
+            return false;
+        }
+        contents.push_back(source->second);
+    }
+    // Slots keep their numbers, the swap file holds no other pages
+    std::sort(used_slots.begin(), used_slots.end());
+    used_slots.erase(std::unique(used_slots.begin(), used_slots.end()), used_slots.end());
+    std::vector<const uint8_t *> slot_contents;
+    for (i = 0; i < used_slots.size(); i++)
+    {
+        std::unordered_map<int, const uint8_t *>::const_iterator source = slots.find(used_slots[i]);
+        if (source == slots.end() || used_slots[i] < 0 || _swap_slots->isUsed(used_slots[i]))
+        {
+            return false;
+        }
+        slot_contents.push_back(source->second);
+    }
+
+    // Only the frames that are in use are copied out of the image
+    for (i = 0; i < used.size(); i++)
+    {
+        _frames->reserve(used[i]);
+        memcpy(_memory + (size_t)used[i] * _page_size, contents[i], _page_size);
+    }
+    _frames_held += used.size();
+    for (i = 0; i < entries.size(); i++)
+    {
+        int frame = entries[i].frame == IMAGE_ZERO_FRAME ? _zero_frame : entries[i].frame;
+        mapFrame(entries[i].pid, entries[i].page_number, frame);
+    }
+    for (i = 0; i < huge.size(); i++)
+    {
+        _huge_map[huge[i].pid][huge[i].page_number] = huge[i].frame;
+        _huge_mappings[(huge[i].page_number >> 29) - 1]++;
+    }
+
+    for (i = 0; i < used_slots.size(); i++)
+    {
+        int slot = used_slots[i];
+        _swap_slots->reserve(slot);
+        if (pwrite(fileno(_swap), slot_contents[i], _page_size, (off_t)slot * _page_size) != _page_size)
+        {
+            fprintf(stderr, "error: can't write to swap file\n");
+        }
+        if (slot >= _slot_refs.size())
+        {
+            _slot_refs.resize(slot + 1, 0);
+        }
+    }
+    for (i = 0; i < swapped.size(); i++)
+    {
+        _swapped[swapped[i].pid][swapped[i].page_number] = swapped[i].frame;
+        _slot_refs[swapped[i].frame]++;
+    }
+
+    _paging = paging;
+    for (i = 0; i < process_paging.size(); i++)
+    {
+        _process_paging[process_paging[i].first] = process_paging[i].second;
+    }
+    return true;
+}
@@ -0,0 +1,226 @@
+#include "replacer.h"
+
+PageReplacer::~PageReplacer()
+{
+}
+
+ListReplacer::ListReplacer(int frames, ReplacementPolicy policy)
+{
+    _policy = policy;
+    _prev.resize(frames, -1);
+    _next.resize(frames, -1);
+    _referenced.resize(frames, 0);
+    _present.resize(frames, 0);
+    _head = -1;
+    _tail = -1;
+}
+
+ListReplacer::~ListReplacer()
+{
+}
+
+void ListReplacer::unlink(int frame)
+{
+    if (_prev[frame] >= 0)
+    {
+        _next[_prev[frame]] = _next[frame];
+    }
+    else
+    {
+        _head = _next[frame];
+    }
+    if (_next[frame] >= 0)
+    {
+        _prev[_next[frame]] = _prev[frame];
+    }
+    else
+    {
+        _tail = _prev[frame];
+    }
+    _prev[frame] = -1;
+    _next[frame] = -1;
+}
+
+void ListReplacer::append(int frame)
+{
+    _prev[frame] = _tail;
+    _next[frame] = -1;
+    if (_tail >= 0)
+    {
+        _next[_tail] = frame;
+    }
+    else
+    {
+        _head = frame;
+    }
+    _tail = frame;
+}
+
+void ListReplacer::insert(int frame)
+{
+    if (_present[frame])
+    {
+        unlink(frame);
+    }
+    _present[frame] = 1;
+    _referenced[frame] = 0;
+    append(frame);
+}
+
+void ListReplacer::access(int frame)
+{
+    if (!_present[frame])
+    {
+        return;
+    }
+    if (_policy == ReplacementPolicy::LeastRecent)
+    {
+        if (_tail != frame)
+        {
+            unlink(frame);
+            append(frame);
+        }
+    }
+    else
+    {
+        _referenced[frame] = 1;
+    }
+}
+
+void ListReplacer::remove(int frame)
+{
+    if (_present[frame])
+    {
+        unlink(frame);
+        _present[frame] = 0;
+    }
+}
+
+int ListReplacer::victim()
+{
+    if (_policy == ReplacementPolicy::SecondChance)
+    {
+        // Terminates: every frame moved to the tail has its bit cleared
+        while (_head >= 0 && _referenced[_head])
+        {
+            int frame = _head;
+            _referenced[frame] = 0;
+            unlink(frame);
+            append(frame);
+        }
+    }
+    int frame = _head;
+    if (frame >= 0)
+    {
+        remove(frame);
+    }
+    return frame;
+}
+
+ClockReplacer::ClockReplacer(int frames, uint64_t window)
+{
+    _referenced.resize(frames, 0);
+    _present.resize(frames, 0);
+    _last_use.resize(frames, 0);
+    _now = 0;
+    _window = window;
+    _hand = 0;
+    _resident = 0;
+}
+
+ClockReplacer::~ClockReplacer()
+{
+}
+
+void ClockReplacer::insert(int frame)
+{
+    if (!_present[frame])
+    {
+        _resident++;
+    }
+    _present[frame] = 1;
+    _referenced[frame] = 1;
+    _last_use[frame] = _now;
+}
+
+void ClockReplacer::access(int frame)
+{
+    _now++;
+    _referenced[frame] = 1;
+}
+
+void ClockReplacer::remove(int frame)
+{
+    if (_present[frame])
+    {
+        _resident--;
+    }
+    _present[frame] = 0;
+    _referenced[frame] = 0;
+}
+
+int ClockReplacer::victim()
+{
+    if (_resident == 0)
+    {
+        return -1;
+    }
+    int frames = _present.size();
+    int oldest = -1;
+    int swept;
+    // Two full sweeps: the first may only clear reference bits
+    for (swept = 0; swept < 2 * frames; swept++)
+    {
+        int frame = _hand;
+        _hand = (_hand + 1) % frames;
+        if (!_present[frame])
+        {
+            continue;
+        }
+        if (_referenced[frame])
+        {
+            _referenced[frame] = 0;
+            _last_use[frame] = _now;
+            continue;
+        }
+        if (_window == 0 || _now - _last_use[frame] > _window)
+        {
+            remove(frame);
+            return frame;
+        }
+        if (oldest < 0 || _last_use[frame] < _last_use[oldest])
+        {
+            oldest = frame;
+        }
+    }
+    // Every frame is in the working set, evict the least recently used one
+    remove(oldest);
+    return oldest;
+}
+
+PageReplacer* createPageReplacer(ReplacementPolicy policy, int frames)
+{
+    switch (policy)
+    {
+        case ReplacementPolicy::Clock:
+            return new ClockReplacer(frames);
+        case ReplacementPolicy::WorkingSet:
+            // Working set window of 16 translations per frame
+            return new ClockReplacer(frames, 16 * (uint64_t)frames);
+        default:
+            return new ListReplacer(frames, policy);
+    }
+}
+
+const char* replacementPolicyName(ReplacementPolicy policy)
+{
+    switch (policy)
+    {
+        case ReplacementPolicy::Fifo:         return "fifo";
+        case ReplacementPolicy::LeastRecent:  return "lru";
+        case ReplacementPolicy::Clock:        return "clock";
+        case ReplacementPolicy::SecondChance: return "second-chance";
+        case ReplacementPolicy::WorkingSet:   return "working-set";
+    }
+    return "unknown";
+}
@@ -0,0 +1,255 @@
+#include "stats.h"
+#include "mmu.h"
+#include "pagetable.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <vector>
+
+void recordLatency(LatencyHistogram *histogram, uint64_t ns)
+{
+    int bucket = ns > 0 ? 63 - __builtin_clzll(ns) : 0;
+    if (bucket >= LATENCY_BUCKETS)
+    {
+        bucket = LATENCY_BUCKETS - 1;
+    }
+    histogram->buckets[bucket]++;
+    histogram->count++;
+    histogram->total_ns += ns;
+    if (ns > histogram->max_ns)
+    {
+        histogram->max_ns = ns;
+    }
+}
+
+uint64_t latencyPercentile(const LatencyHistogram *histogram, double p)
+{
+    if (histogram->count == 0)
+    {
+        return 0;
+    }
+    // Nearest rank: the smallest call with at least `p` of the calls at or below it
+    uint64_t rank = (uint64_t)std::ceil(p * histogram->count);
+    rank = std::max<uint64_t>(1, std::min(rank, histogram->count));
+    uint64_t seen = 0;
+    int i;
+    for (i = 0; i < LATENCY_BUCKETS - 1; i++)
+    {
+        seen += histogram->buckets[i];
+        if (seen >= rank)
+        {
+            break;
+        }
+    }
+    return std::min(2ULL << i, (unsigned long long)histogram->max_ns);
+}
+
+const char* simOpName(SimOp op)
+{
+    switch (op)
+    {
+        case SimOp::OpCreate:    return "create";
+        case SimOp::OpAllocate:  return "allocate";
+        case SimOp::OpSet:       return "set";
+        case SimOp::OpRead:      return "print";
+        case SimOp::OpFree:      return "free";
+        case SimOp::OpFork:      return "fork";
+        case SimOp::OpTerminate: return "terminate";
+        case SimOp::OpCompact:   return "compact";
+        case SimOp::OpFill:      return "fill";
+        case SimOp::OpCopy:      return "copy";
+        case SimOp::OpCompare:   return "cmp";
+        default:                 return "unknown";
+    }
+}
+
+OpTimer::OpTimer(Mmu *mmu, SimOp op)
+{
+    _mmu = mmu;
+    _op = op;
+    _start = std::chrono::steady_clock::now();
+}
+
+OpTimer::~OpTimer()
+{
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+    _mmu->recordLatency(_op, std::chrono::duration_cast<std::chrono::nanoseconds>(end - _start).count());
+}
+
+// One row of counters, the same fields in every format
+typedef struct StatsField {
+    const char *name;
+    uint64_t value;
+} StatsField;
+
+typedef struct StatsRow {
+    std::string id; // pid or operation, empty for the global row
+    std::vector<StatsField> fields;
+} StatsRow;
+
+static void addField(StatsRow &row, const char *name, uint64_t value)
+{
+    StatsField field = {name, value};
+    row.fields.push_back(field);
+}
+
+static void writeTable(const char *id_name, std::vector<StatsRow> &rows, FILE *out)
+{
+    if (rows.empty())
+    {
+        return;
+    }
+    std::vector<int> widths;
+    std::string rule = "-----------";
+    fprintf(out, " %-9s", id_name);
+    int i;
+    for (i = 0; i < rows[0].fields.size(); i++)
+    {
+        int width = std::max(10, (int)strlen(rows[0].fields[i].name));
+        widths.push_back(width);
+        fprintf(out, " | %*s", width, rows[0].fields[i].name);
+        rule += "+" + std::string(width + 2, '-');
+    }
+    fprintf(out, "\n%s\n", rule.c_str());
+    int r;
+    for (r = 0; r < rows.size(); r++)
+    {
+        fprintf(out, " %-9s", rows[r].id.c_str());
+        for (i = 0; i < rows[r].fields.size(); i++)
+        {
+            fprintf(out, " | %*llu", widths[i], (unsigned long long)rows[r].fields[i].value);
+        }
+        fprintf(out, "\n");
+    }
+}
+
+static void writeJsonObject(StatsRow &row, FILE *out)
+{
+    fprintf(out, "{");
+    int i;
+    for (i = 0; i < row.fields.size(); i++)
+    {
+        fprintf(out, "%s\"%s\": %llu", i > 0 ? ", " : "", row.fields[i].name, (unsigned long long)row.fields[i].value);
+    }
+    fprintf(out, "}");
+}
+
+static void writeCsvRows(const char *scope, std::vector<StatsRow> &rows, FILE *out)
+{
+    int r;
+    for (r = 0; r < rows.size(); r++)
+    {
+        int i;
+        for (i = 0; i < rows[r].fields.size(); i++)
+        {
+            fprintf(out, "%s,%s,%s,%llu\n", scope, rows[r].id.c_str(), rows[r].fields[i].name,
+                    (unsigned long long)rows[r].fields[i].value);
+        }
+    }
+}
+
+void writeStats(Mmu *mmu, PageTable *page_table, StatsFormat format, FILE *out)
+{
+    std::unordered_map<uint32_t, uint32_t> pages;
+    uint32_t total_pages = page_table->countPages(pages);
+    std::vector<uint32_t> live;
+    mmu->processIds(live);
+    std::sort(live.begin(), live.end());
+
+    std::vector<StatsRow> global(1);
+    MmuStats *totals = mmu->stats();
+    PagingStats paging = page_table->pagingStats();
+    addField(global[0], "processes", live.size());
+    addField(global[0], "allocations", totals->allocations);
+    addField(global[0], "frees", totals->frees);
+    addField(global[0], "failed_allocations", totals->failed_allocations);
+    addField(global[0], "coalesces", totals->coalesces);
+    addField(global[0], "bytes_live", totals->bytes_live);
+    addField(global[0], "pages_mapped", total_pages);
+    addField(global[0], "frames_in_use", page_table->framesInUse());
+    addField(global[0], "translations", totals->translations);
+    addField(global[0], "page_faults", paging.faults);
+    addField(global[0], "evictions", paging.evictions);
+
+    std::vector<StatsRow> processes;
+    int i;
+    for (i = 0; i < live.size(); i++)
+    {
+        MmuStats *stats = mmu->processStats(live[i]);
+        if (stats == NULL)
+        {
+            continue;
+        }
+        PagingStats process_paging = page_table->processPagingStats(live[i]);
+        StatsRow row;
+        row.id = std::to_string(live[i]);
+        addField(row, "allocations", stats->allocations);
+        addField(row, "frees", stats->frees);
+        addField(row, "failed", stats->failed_allocations);
+        addField(row, "coalesces", stats->coalesces);
+        addField(row, "bytes_live", stats->bytes_live);
+        addField(row, "pages", pages[live[i]]);
+        addField(row, "translations", stats->translations);
+        addField(row, "faults", process_paging.faults);
+        addField(row, "evictions", process_paging.evictions);
+        processes.push_back(row);
+    }
+
+    std::vector<StatsRow> latency;
+    int op;
+    for (op = 0; op < SimOp::OpCount; op++)
+    {
+        const LatencyHistogram *histogram = mmu->latency((SimOp)op);
+        StatsRow row;
+        row.id = simOpName((SimOp)op);
+        addField(row, "calls", histogram->count);
+        addField(row, "mean_ns", histogram->count > 0 ? histogram->total_ns / histogram->count : 0);
+        addField(row, "p50_ns", latencyPercentile(histogram, 0.50));
+        addField(row, "p90_ns", latencyPercentile(histogram, 0.90));
+        addField(row, "p99_ns", latencyPercentile(histogram, 0.99));
+        addField(row, "max_ns", histogram->max_ns);
+        latency.push_back(row);
+    }
+
+    if (format == StatsFormat::StatsJson)
+    {
+        fprintf(out, "{\n  \"global\": ");
+        writeJsonObject(global[0], out);
+        fprintf(out, ",\n  \"processes\": {");
+        for (i = 0; i < processes.size(); i++)
+        {
+            fprintf(out, "%s\n    \"%s\": ", i > 0 ? "," : "", processes[i].id.c_str());
+            writeJsonObject(processes[i], out);
+        }
+        fprintf(out, "%s},\n  \"latency\": {", processes.empty() ? "" : "\n  ");
+        for (i = 0; i < latency.size(); i++)
+        {
+            fprintf(out, "%s\n    \"%s\": ", i > 0 ? "," : "", latency[i].id.c_str());
+            writeJsonObject(latency[i], out);
+        }
+        fprintf(out, "\n  }\n}\n");
+    }
+    else if (format == StatsFormat::StatsCsv)
+    {
+        fprintf(out, "scope,id,metric,value\n");
+        writeCsvRows("global", global, out);
+        writeCsvRows("process", processes, out);
+        writeCsvRows("latency", latency, out);
+    }
+    else
+    {
+        for (i = 0; i < global[0].fields.size(); i++)
+        {
+            fprintf(out, "%-22s : %llu\n", global[0].fields[i].name, (unsigned long long)global[0].fields[i].value);
+        }
+        fprintf(out, "\n");
+        writeTable("PID", processes, out);
+        if (!processes.empty())
+        {
+            fprintf(out, "\n");
+        }
+        // Percentiles are the upper bounds of power of two buckets
+        writeTable("Operation", latency, out);
+    }
+}
@@ -0,0 +1,155 @@
+#include "tlb.h"
+
+Tlb::Tlb(int entries, int ways, TlbPolicy policy)
+{
+    if (ways < 1)
+    {
+        ways = 1;
+    }
+    if (entries < ways)
+    {
+        entries = ways;
+    }
+    _ways = ways;
+    _sets = entries / ways;
+    _policy = policy;
+    _clock = 0;
+    _random_state = 2463534242u;
+    _hits = 0;
+    _misses = 0;
+
+    TlbEntry empty = {0, 0, -1, 0, false};
+    _entries.resize(_sets * _ways, empty);
+}
+
+Tlb::~Tlb()
+{
+}
+
+int Tlb::setIndex(uint32_t pid, int page_number)
+{
+    uint32_t hash = (uint32_t)page_number ^ (pid * 2654435761u);
+    return hash % _sets;
+}
+
+int Tlb::lookup(uint32_t pid, int page_number, bool count_miss)
+{
+    TlbEntry *set = &_entries[setIndex(pid, page_number) * _ways];
+    int i;
+    for (i = 0; i < _ways; i++)
+    {
+        if (set[i].valid && set[i].page_number == page_number && set[i].pid == pid)
+        {
+            set[i].last_used = ++_clock;
+            _hits++;
+            return set[i].frame;
+        }
+    }
+    if (count_miss)
+    {
+        _misses++;
+    }
+    return -1;
+}
+
+void Tlb::insert(uint32_t pid, int page_number, int frame)
+{
+    TlbEntry *set = &_entries[setIndex(pid, page_number) * _ways];
+    TlbEntry *victim = NULL;
+    int i;
+    // Prefer an invalid way, otherwise evict according to the replacement policy
+    for (i = 0; i < _ways; i++)
+    {
+        if (!set[i].valid)
+        {
+            victim = &set[i];
+            break;
+        }
+    }
+    if (victim == NULL)
+    {
+        if (_policy == TlbPolicy::Random)
+        {
+            // xorshift32
+            _random_state ^= _random_state << 13;
+            _random_state ^= _random_state >> 17;
+            _random_state ^= _random_state << 5;
+            victim = &set[_random_state % _ways];
+        }
+        else
+        {
+            victim = &set[0];
+            for (i = 1; i < _ways; i++)
+            {
+                if (set[i].last_used < victim->last_used)
+                {
+                    victim = &set[i];
+                }
+            }
+        }
+    }
+    victim->pid = pid;
+    victim->page_number = page_number;
+    victim->frame = frame;
+    victim->last_used = ++_clock;
+    victim->valid = true;
+}
+
+void Tlb::invalidate(uint32_t pid, int page_number)
+{
+    TlbEntry *set = &_entries[setIndex(pid, page_number) * _ways];
+    int i;
+    for (i = 0; i < _ways; i++)
+    {
+        if (set[i].valid && set[i].page_number == page_number && set[i].pid == pid)
+        {
+            set[i].valid = false;
+        }
+    }
+}
+
+void Tlb::invalidateProcess(uint32_t pid)
+{
+    int i;
+    for (i = 0; i < _entries.size(); i++)
+    {
+        if (_entries[i].pid == pid)
+        {
+            _entries[i].valid = false;
+        }
+    }
+}
+
+void Tlb::flush()
+{
+    int i;
+    for (i = 0; i < _entries.size(); i++)
+    {
+        _entries[i].valid = false;
+    }
+}
+
+int Tlb::size()
+{
+    return _entries.size();
+}
+
+int Tlb::ways()
+{
+    return _ways;
+}
+
+TlbPolicy Tlb::policy()
+{
+    return _policy;
+}
+
+uint64_t Tlb::hits()
+{
+    return _hits;
+}
+
+uint64_t Tlb::misses()
+{
+    return _misses;
+}
@@ -0,0 +1,612 @@
+#include "trace.h"
+#include "memsim.h"
+#include "commandreader.h"
+#include <cstring>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Bytes of padding needed after a payload of `size` bytes
+static uint32_t tracePadding(uint32_t size)
+{
+    return (4 - size % 4) % 4;
+}
+
+static void writeEvent(FILE *file, uint8_t op, uint8_t type, uint32_t a, uint32_t b, uint32_t c, uint32_t d)
+{
+    TraceEvent event = {op, type, 0, a, b, c, d};
+    fwrite(&event, sizeof(event), 1, file);
+}
+
+static void writePayload(FILE *file, const void *data, uint32_t size)
+{
+    static const char zeros[4] = {0, 0, 0, 0};
+    fwrite(data, 1, size, file);
+    fwrite(zeros, 1, tracePadding(size), file);
+}
+
+// State the converter needs to know to encode commands: name ids, and the
+// type of every variable so that `set` values can be stored in binary
+typedef struct TraceConverter {
+    FILE *file;
+    uint64_t event_count;
+    uint32_t next_pid;
+    std::unordered_set<uint32_t> live_pids;
+    std::unordered_map<std::string, uint32_t> names;
+    std::unordered_map<uint64_t, DataType> types; // (pid << 32 | name id) -> type
+} TraceConverter;
+
+static uint32_t traceName(TraceConverter *conv, const std::string &name)
+{
+    std::unordered_map<std::string, uint32_t>::iterator it = conv->names.find(name);
+    if (it != conv->names.end())
+    {
+        return it->second;
+    }
+    uint32_t id = conv->names.size();
+    conv->names[name] = id;
+    writeEvent(conv->file, TraceOp::TraceName, 0, id, name.size(), 0, 0);
+    writePayload(conv->file, name.data(), name.size());
+    conv->event_count++;
+    return id;
+}
+
+static uint64_t traceVariableKey(uint32_t pid, uint32_t name_id)
+{
+    return ((uint64_t)pid << 32) | name_id;
+}
+
+// Encode one text command, returns false if the command is invalid
+static bool traceCommand(TraceConverter *conv, std::vector<const char *> &command_list)
+{
+    const char *token = command_list[0];
+    if (strcmp(token, "create") == 0)
+    {
+        if (command_list.size() != 3 || !stringToIntTest(command_list[1]) || !stringToIntTest(command_list[2]))
+        {
+            return false;
+        }
+        writeEvent(conv->file, TraceOp::TraceCreate, 0, std::stoi(command_list[1]), std::stoi(command_list[2]), 0, 0);
+        conv->live_pids.insert(conv->next_pid);
+        conv->next_pid++;
+    }
+    else if (strcmp(token, "allocate") == 0)
+    {
+        if (command_list.size() != 5 || !stringToIntTest(command_list[1]) || !stringToIntTest(command_list[4]))
+        {
+            return false;
+        }
+        uint32_t pid = std::stoi(command_list[1]);
+        uint32_t name = traceName(conv, command_list[2]);
+        DataType type = dataTypeFromName(command_list[3]);
+        uint64_t key = traceVariableKey(pid, name);
+        if (conv->types.find(key) == conv->types.end())
+        {
+            conv->types[key] = type;
+        }
+        writeEvent(conv->file, TraceOp::TraceAllocate, type, pid, name, std::stoi(command_list[4]), 0);
+    }
+    else if (strcmp(token, "set") == 0)
+    {
+        if (command_list.size() <= 4 || !stringToIntTest(command_list[1]) || !stringToIntTest(command_list[3]))
+        {
+            return false;
+        }
+        uint32_t pid = std::stoi(command_list[1]);
+        uint32_t name = traceName(conv, command_list[2]);
+        std::unordered_map<uint64_t, DataType>::iterator it = conv->types.find(traceVariableKey(pid, name));
+        DataType type = it != conv->types.end() ? it->second : DataType::Err;
+        std::vector<uint8_t> values;
+        uint32_t count = 0;
+        if (type != DataType::Err)
+        {
+            if (!parseValues(type, command_list, 4, values))
+            {
+                return false;
+            }
+            count = command_list.size() - 4;
+        }
+        writeEvent(conv->file, TraceOp::TraceSet, type, pid, name, std::stoi(command_list[3]), count);
+        writePayload(conv->file, values.data(), values.size());
+    }
+    else if (strcmp(token, "free") == 0)
+    {
+        if (command_list.size() <= 2 || !stringToIntTest(command_list[1]))
+        {
+            return false;
+        }
+        uint32_t pid = std::stoi(command_list[1]);
+        uint32_t name = traceName(conv, command_list[2]);
+        conv->types.erase(traceVariableKey(pid, name));
+        writeEvent(conv->file, TraceOp::TraceFree, 0, pid, name, 0, 0);
+    }
+    else if (strcmp(token, "fork") == 0)
+    {
+        if (command_list.size() < 2 || !stringToIntTest(command_list[1]))
+        {
+            return false;
+        }
+        uint32_t pid = std::stoi(command_list[1]);
+        writeEvent(conv->file, TraceOp::TraceFork, 0, pid, 0, 0, 0);
+        // The child inherits the parent's variables, forking a missing process creates nothing
+        if (conv->live_pids.count(pid) > 0)
+        {
+            std::vector<std::pair<uint64_t, DataType> > inherited;
+            std::unordered_map<uint64_t, DataType>::iterator it;
+            for (it = conv->types.begin(); it != conv->types.end(); it++)
+            {
+                if ((it->first >> 32) == pid)
+                {
+                    inherited.push_back(std::make_pair(traceVariableKey(conv->next_pid, (uint32_t)it->first), it->second));
+                }
+            }
+            conv->types.insert(inherited.begin(), inherited.end());
+            conv->live_pids.insert(conv->next_pid);
+            conv->next_pid++;
+        }
+    }
+    else if (strcmp(token, "terminate") == 0)
+    {
+        if (command_list.size() < 2 || !stringToIntTest(command_list[1]))
+        {
+            return false;
+        }
+        writeEvent(conv->file, TraceOp::TraceTerminate, 0, std::stoi(command_list[1]), 0, 0, 0);
+        conv->live_pids.erase(std::stoi(command_list[1]));
+    }
+    else if (strcmp(token, "print") == 0 && command_list.size() > 1 && strchr(command_list[1], ':') != NULL)
+    {
+        std::string print_str = command_list[1];
+        size_t sep = print_str.find(":");
+        std::string pid_string = print_str.substr(0, sep);
+        if (!stringToIntTest(pid_string) || pid_string == "")
+        {
+            return false;
+        }
+        uint32_t pid = std::stoi(pid_string);
+        uint32_t name = traceName(conv, print_str.substr(sep + 1));
+        writeEvent(conv->file, TraceOp::TraceRead, 0, pid, name, 0, 0);
+    }
+    else
+    {
+        return false;
+    }
+    conv->event_count++;
+    return true;
+}
+
+int convertTrace(const char *text_path, const char *trace_path)
+{
+    FILE *text = fopen(text_path, "r");
+    if (text == NULL)
+    {
+        fprintf(stderr, "Error: can't open '%s'\n", text_path);
+        return 1;
+    }
+    TraceConverter conv;
+    conv.file = fopen(trace_path, "wb");
+    if (conv.file == NULL)
+    {
+        fprintf(stderr, "Error: can't create '%s'\n", trace_path);
+        fclose(text);
+        return 1;
+    }
+    conv.event_count = 0;
+    conv.next_pid = 1024;
+
+    // Header is rewritten with the final event count at the end
+    TraceHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+    header.version = TRACE_VERSION;
+    fwrite(&header, sizeof(header), 1, conv.file);
+
+    CommandReader reader(text);
+    std::vector<const char *> command_list;
+    uint64_t line = 0;
+    uint64_t skipped = 0;
+    char *command;
+    while ((command = reader.nextLine()) != NULL)
+    {
+        line++;
+        splitCommand(command, command_list);
+        if (command_list.empty())
+        {
+            continue;
+        }
+        if (strcmp(command_list[0], "exit") == 0)
+        {
+            break;
+        }
+        bool converted = false;
+        try
+        {
+            converted = traceCommand(&conv, command_list);
+        }
+        catch (const std::exception &e)
+        {
+            converted = false;
+        }
+        if (!converted)
+        {
+            fprintf(stderr, "warning: line %llu '%s' not traced\n", (unsigned long long)line, command_list[0]);
+            skipped++;
+        }
+    }
+
+    header.event_count = conv.event_count;
+    fseek(conv.file, 0, SEEK_SET);
+    fwrite(&header, sizeof(header), 1, conv.file);
+    fclose(conv.file);
+    fclose(text);
+
+    fprintf(stderr, "converted %llu lines into %llu events (%llu commands not traced)\n",
+            (unsigned long long)line, (unsigned long long)conv.event_count, (unsigned long long)skipped);
+    return 0;
+}
+
+// Write the values of a set event with one bulk write
+static void replaySet(const TraceEvent *event, const uint8_t *values, const std::string &var_name,
+                      Mmu *mmu, PageTable *page_table, void *memory)
+{
+    Variable *var = findSetTarget(event->a, var_name, event->c, mmu);
+    if (var == NULL)
+    {
+        return;
+    }
+    writeElements(event->a, var_name, (DataType)event->type, event->c, values, event->d, mmu, page_table, memory);
+}
+
+// Memory-map a trace file and check its header, returns NULL (after
+// printing the error) if it can't be read
+static const uint8_t* mapTrace(const char *trace_path, size_t *length)
+{
+    int fd = open(trace_path, O_RDONLY);
+    if (fd < 0)
+    {
+        fprintf(stderr, "Error: can't open '%s'\n", trace_path);
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < sizeof(TraceHeader))
+    {
+        fprintf(stderr, "Error: '%s' is not a trace file\n", trace_path);
+        close(fd);
+        return NULL;
+    }
+    *length = st.st_size;
+    const uint8_t *data = (const uint8_t *)mmap(NULL, *length, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        fprintf(stderr, "Error: can't map '%s'\n", trace_path);
+        return NULL;
+    }
+    madvise((void *)data, *length, MADV_SEQUENTIAL);
+
+    const TraceHeader *header = (const TraceHeader *)data;
+    if (memcmp(header->magic, TRACE_MAGIC, sizeof(header->magic)) != 0 || header->version != TRACE_VERSION)
+    {
+        fprintf(stderr, "Error: '%s' is not a trace file\n", trace_path);
+        munmap((void *)data, *length);
+        return NULL;
+    }
+    return data;
+}
+
+// Size of the payload following an event, in 64 bits since a corrupt
+// count times the type size can overflow 32
+static uint64_t payloadSize(const TraceEvent *event)
+{
+    if (event->op == TraceOp::TraceName)
+    {
+        return event->b;
+    }
+    if (event->op == TraceOp::TraceSet && event->type != DataType::Err)
+    {
+        return (uint64_t)event->d * dataTypeSize((DataType)event->type);
+    }
+    return 0;
+}
+
+// Check that the payload of the event at `position` lies within the trace,
+// and that a name event declares the next name id (names are declared
+// densely, in order), so a corrupt trace can't make replay read past the
+// mapping or allocate a huge name table
+static bool checkEvent(const TraceEvent *event, size_t position, size_t length, size_t name_count,
+                       uint64_t *payload_size)
+{
+    *payload_size = payloadSize(event);
+    if (*payload_size > length - position - sizeof(TraceEvent))
+    {
+        return false;
+    }
+    return event->op != TraceOp::TraceName || event->a == name_count;
+}
+
+// Run one event other than TraceName, returns false if the op is unknown
+static bool runEvent(const TraceEvent *event, const uint8_t *payload, const std::string &name,
+                     Mmu *mmu, PageTable *page_table, void *memory)
+{
+    switch (event->op)
+    {
+        case TraceOp::TraceCreate:
+            createProcess(event->a, event->b, mmu, page_table);
+            break;
+        case TraceOp::TraceAllocate:
+            allocateVariable(event->a, name, (DataType)event->type, event->c, mmu, page_table);
+            break;
+        case TraceOp::TraceSet:
+            replaySet(event, payload, name, mmu, page_table, memory);
+            break;
+        case TraceOp::TraceFree:
+            freeVariable(event->a, name, mmu, page_table);
+            compactIfFragmented(event->a, mmu, page_table, memory);
+            break;
+        case TraceOp::TraceTerminate:
+            terminateProcess(event->a, mmu, page_table);
+            break;
+        case TraceOp::TraceFork:
+            forkProcess(event->a, mmu, page_table);
+            break;
+        case TraceOp::TraceRead:
+            printVariable(event->a, name, mmu, page_table, memory);
+            break;
+        default:
+            return false;
+    }
+    return true;
+}
+
+int replayTrace(const char *trace_path, Mmu *mmu, PageTable *page_table, void *memory)
+{
+    size_t length;
+    const uint8_t *data = mapTrace(trace_path, &length);
+    if (data == NULL)
+    {
+        return 1;
+    }
+    const TraceHeader *header = (const TraceHeader *)data;
+
+    static const std::string no_name;
+    std::vector<std::string> names;
+    size_t position = sizeof(TraceHeader);
+    uint64_t n;
+    for (n = 0; n < header->event_count && position + sizeof(TraceEvent) <= length; n++)
+    {
+        const TraceEvent *event = (const TraceEvent *)(data + position);
+        const uint8_t *payload = data + position + sizeof(TraceEvent);
+        uint64_t payload_size;
+        if (!checkEvent(event, position, length, names.size(), &payload_size))
+        {
+            fprintf(stderr, "Error: bad trace event %llu\n", (unsigned long long)n);
+            munmap((void *)data, length);
+            return 1;
+        }
+
+        if (event->op == TraceOp::TraceName)
+        {
+            names.push_back(std::string((const char *)payload, event->b));
+        }
+        else if (!runEvent(event, payload, event->b < names.size() ? names[event->b] : no_name, mmu, page_table, memory))
+        {
+            fprintf(stderr, "Error: bad trace event %llu\n", (unsigned long long)n);
+            munmap((void *)data, length);
+            return 1;
+        }
+        position += sizeof(TraceEvent) + payload_size + tracePadding(payload_size);
+    }
+
+    munmap((void *)data, length);
+    return 0;
+}
+
+// Parallel replay
+//
+// Each shard runs a group of processes (a created process and every process
+// forked from it) on a worker thread of its own, with an Mmu and page table
+// of its own, so shards never touch the same process state. The dispatching
+// thread decodes events and queues them in batches to the shard that runs
+// their process. Pids are handed out by the dispatcher, in trace order, so
+// they are the same as with a serial replay.
+
+#define SHARD_BATCH_SIZE 256
+#define SHARD_MAX_BATCHES 64
+
+typedef struct ShardJob {
+    const TraceEvent *event;
+    const uint8_t *payload;
+    const std::string *name;
+    uint32_t pid; // pid given to the process a create or fork event makes
+} ShardJob;
+
+typedef struct Shard {
+    Mmu *mmu;
+    PageTable *page_table;
+    std::vector<ShardJob> pending; // batch being filled by the dispatcher
+    std::deque<std::vector<ShardJob> > batches;
+    bool done;
+    std::mutex lock;
+    std::condition_variable has_batch;
+    std::condition_variable has_room;
+    std::thread worker;
+} Shard;
+
+static void runShard(Shard *shard, void *memory)
+{
+    std::vector<ShardJob> batch;
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> guard(shard->lock);
+            while (shard->batches.empty() && !shard->done)
+            {
+                shard->has_batch.wait(guard);
+            }
+            if (shard->batches.empty())
+            {
+                break;
+            }
+            batch.swap(shard->batches.front());
+            shard->batches.pop_front();
+        }
+        shard->has_room.notify_one();
+
+        int i;
+        for (i = 0; i < batch.size(); i++)
+        {
+            const TraceEvent *event = batch[i].event;
+            if (event->op == TraceOp::TraceCreate || event->op == TraceOp::TraceFork)
+            {
+                shard->mmu->setNextPid(batch[i].pid);
+            }
+            // Keep each line of output in one piece
+            bool prints = event->op != TraceOp::TraceSet && event->op != TraceOp::TraceFree &&
+                          event->op != TraceOp::TraceTerminate;
+            if (prints)
+            {
+                flockfile(stdout);
+            }
+            runEvent(event, batch[i].payload, *batch[i].name, shard->mmu, shard->page_table, memory);
+            if (prints)
+            {
+                funlockfile(stdout);
+            }
+        }
+        batch.clear();
+    }
+}
+
+static void queueBatch(Shard *shard)
+{
+    {
+        std::unique_lock<std::mutex> guard(shard->lock);
+        while (shard->batches.size() >= SHARD_MAX_BATCHES)
+        {
+            shard->has_room.wait(guard);
+        }
+        shard->batches.push_back(std::vector<ShardJob>());
+        shard->batches.back().swap(shard->pending);
+    }
+    shard->has_batch.notify_one();
+    shard->pending.reserve(SHARD_BATCH_SIZE);
+}
+
+int replayTraceParallel(const char *trace_path, std::vector<Mmu *> &mmus, std::vector<PageTable *> &page_tables, void *memory)
+{
+    size_t length;
+    const uint8_t *data = mapTrace(trace_path, &length);
+    if (data == NULL)
+    {
+        return 1;
+    }
+    const TraceHeader *header = (const TraceHeader *)data;
+
+    int shard_count = mmus.size();
+    std::vector<Shard *> shards(shard_count);
+    int s;
+    for (s = 0; s < shard_count; s++)
+    {
+        shards[s] = new Shard();
+        shards[s]->mmu = mmus[s];
+        shards[s]->page_table = page_tables[s];
+        shards[s]->done = false;
+        shards[s]->pending.reserve(SHARD_BATCH_SIZE);
+        shards[s]->worker = std::thread(runShard, shards[s], memory);
+    }
+
+    // Names are never moved once added, shards keep pointers to them
+    static const std::string no_name;
+    std::deque<std::string> names;
+    std::unordered_map<uint32_t, int> process_shard; // live pid -> shard
+    uint32_t next_pid = mmus[0]->nextPid();
+    int next_shard = 0;
+    int status = 0;
+    size_t position = sizeof(TraceHeader);
+    uint64_t n;
+    for (n = 0; n < header->event_count && position + sizeof(TraceEvent) <= length; n++)
+    {
+        const TraceEvent *event = (const TraceEvent *)(data + position);
+        ShardJob job = {event, data + position + sizeof(TraceEvent), &no_name, 0};
+        uint64_t payload_size;
+        if (!checkEvent(event, position, length, names.size(), &payload_size))
+        {
+            fprintf(stderr, "Error: bad trace event %llu\n", (unsigned long long)n);
+            status = 1;
+            break;
+        }
+        position += sizeof(TraceEvent) + payload_size + tracePadding(payload_size);
+
+        if (event->op == TraceOp::TraceName)
+        {
+            names.push_back(std::string((const char *)job.payload, event->b));
+            continue;
+        }
+        if (event->op > TraceOp::TraceFork)
+        {
+            fprintf(stderr, "Error: bad trace event %llu\n", (unsigned long long)n);
+            status = 1;
+            break;
+        }
+        if (event->op != TraceOp::TraceCreate && event->b < names.size())
+        {
+            job.name = &names[event->b];
+        }
+
+        // Processes that don't exist go to any shard, which reports the error
+        std::unordered_map<uint32_t, int>::iterator it = process_shard.find(event->a);
+        int shard = it != process_shard.end() ? it->second : event->a % shard_count;
+        if (event->op == TraceOp::TraceCreate)
+        {
+            job.pid = next_pid++;
+            shard = next_shard;
+            next_shard = (next_shard + 1) % shard_count;
+            process_shard[job.pid] = shard;
+        }
+        else if (event->op == TraceOp::TraceFork && it != process_shard.end())
+        {
+            // The child shares frames with its parent, so it runs on the same shard
+            job.pid = next_pid++;
+            process_shard[job.pid] = shard;
+        }
+        else if (event->op == TraceOp::TraceTerminate && it != process_shard.end())
+        {
+            process_shard.erase(it);
+        }
+
+        shards[shard]->pending.push_back(job);
+        if (shards[shard]->pending.size() == SHARD_BATCH_SIZE)
+        {
+            queueBatch(shards[shard]);
+        }
+    }
+
+    for (s = 0; s < shard_count; s++)
+    {
+        if (!shards[s]->pending.empty())
+        {
+            queueBatch(shards[s]);
+        }
+        {
+            std::unique_lock<std::mutex> guard(shards[s]->lock);
+            shards[s]->done = true;
+        }
+        shards[s]->has_batch.notify_one();
+    }
+    for (s = 0; s < shard_count; s++)
+    {
+        shards[s]->worker.join();
+        delete shards[s];
+    }
+
+    munmap((void *)data, length);
+    return status;
+}